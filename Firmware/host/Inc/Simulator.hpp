@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#include "Debounce.hpp"
+#include "MatrixScan.hpp"
+#include "ReportScheduler.hpp"
+#include "UsbHid.hpp"
+
+// Runs the firmware from the matrix scan to the HID reports on the host. The
+// virtual matrix is scanned every SCAN_PERIOD_US by the matrix scanner, its
+// events go through the key pipeline as in the USB task, and the reports are
+// packed and scheduled by the report scheduler. The endpoint is a fake host
+// that takes every report as soon as it is sent, and records the state it
+// sees after each one. The pipeline state is global, so only one simulator
+// may exist at a time.
+class Simulator {
+  public:
+    static constexpr uint32_t SCAN_PERIOD_US = 250;
+
+    // Key change of a timeline, at a time relative to its start
+    struct Step {
+        uint32_t timeUs;
+        uint8_t column;
+        uint8_t row;
+        bool isPressed;
+    };
+
+    // State seen by the host after a report and when it was sent
+    struct Report {
+        uint32_t timeUs;
+        usb_hid::KbHidReport report;
+    };
+
+    Simulator(debounce::Algorithm algorithm,
+              uint8_t debounceTimeMs,
+              bool isBootProtocol = false);
+    ~Simulator();
+
+    // Applies every step on the first scan at or after its time and keeps
+    // scanning until durationUs have passed. Steps must be sorted by time.
+    void Replay(std::initializer_list<Step> steps, uint32_t durationUs);
+
+    void Run(uint32_t durationUs) {
+        Replay({}, durationUs);
+    }
+
+    uint32_t GetTime() const {
+        return m_timeUs;
+    }
+
+    const std::vector<Report>& GetReports() const {
+        return m_reports;
+    }
+
+    void ClearReports() {
+        m_reports.clear();
+    }
+
+  private:
+    void Scan();
+    void Record(uint8_t reportId, const uint8_t* data, uint8_t size);
+
+    // Keeps running across simulators, the pipeline expects time to only go
+    // forward
+    static int64_t s_clockUs;
+
+    const bool m_isBootProtocol;
+    matrix_scan::Scanner m_scanner;
+    usb_hid::ReportScheduler m_reportScheduler;
+    // What the host has been sent so far
+    usb_hid::KbHidReport m_hostState = {};
+    uint32_t m_timeUs                = 0;
+    std::vector<Report> m_reports;
+};
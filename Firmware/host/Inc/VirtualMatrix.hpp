@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+#include "KeyBitmap.hpp"
+
+// Switches of the virtual matrix read by the host backend of matrix_io
+namespace virtual_matrix {
+
+void Set(uint8_t column, uint8_t row, bool isPressed);
+
+// Releases every key
+void Clear();
+
+const KeyBitmap& Get();
+
+} // namespace virtual_matrix
@@ -0,0 +1,4 @@
+#pragma once
+
+// Stand-in for the configuration generated by the firmware build. Every
+// optional feature is left out, the host build only runs the key pipeline.
@@ -0,0 +1,9 @@
+#pragma once
+
+// TinyUSB configuration of the host build, which only uses the HID
+// definitions. The device stack itself is never compiled.
+#define CFG_TUSB_MCU OPT_MCU_ESP32S3
+#define CFG_TUSB_OS  OPT_OS_NONE
+
+#define CFG_TUD_ENABLED 1
+#define CFG_TUD_HID     1
@@ -0,0 +1,7 @@
+#include "Benchmark.hpp"
+
+// Host side of the benchmarks, times are in nanoseconds
+int main() {
+    benchmark::RunPortable();
+    return 0;
+}
@@ -0,0 +1,12 @@
+#include "Leds.hpp"
+
+// The keymap drives the LEDs through actions, which have no effect on the
+// reports and nothing to show on the host
+
+namespace leds {
+
+void DecreaseBrightness([[maybe_unused]] bool isPressed) {}
+
+void IncreaseBrightness([[maybe_unused]] bool isPressed) {}
+
+} // namespace leds
@@ -0,0 +1,110 @@
+#include "Simulator.hpp"
+
+#include <cstring>
+
+#include "KeyPipeline.hpp"
+#include "Macros.hpp"
+#include "MatrixIo.hpp"
+#include "VirtualMatrix.hpp"
+
+int64_t Simulator::s_clockUs;
+
+// The scanner, the pipeline and the scheduler take plain functions
+static Simulator* instance;
+
+Simulator::Simulator(debounce::Algorithm algorithm,
+                     uint8_t debounceTimeMs,
+                     bool isBootProtocol)
+    : m_isBootProtocol(isBootProtocol),
+      m_scanner(
+          algorithm,
+          debounceTimeMs,
+          [] { return s_clockUs; },
+          key_pipeline::Process),
+      m_reportScheduler(
+          [] { return true; },
+          [](uint8_t reportId, const uint8_t* data, uint8_t size) {
+              instance->Record(reportId, data, size);
+              return true;
+          },
+          [] { return true; }) {
+    instance = this;
+    virtual_matrix::Clear();
+    matrix_io::Init();
+    key_pipeline::Init([](const usb_hid::KbHidReport& report) {
+        return instance->m_reportScheduler.Post(report,
+                                                instance->m_isBootProtocol);
+    });
+
+    // As once the device is mounted, the host starts from the idle state
+    key_pipeline::Repost();
+    m_reportScheduler.Flush();
+    m_reports.clear();
+}
+
+Simulator::~Simulator() {
+    instance = nullptr;
+}
+
+void Simulator::Replay(std::initializer_list<Step> steps,
+                       uint32_t durationUs) {
+    const uint32_t startUs = m_timeUs;
+    const Step* nextStep   = steps.begin();
+    while (m_timeUs - startUs < durationUs) {
+        while (nextStep != steps.end() &&
+               nextStep->timeUs <= m_timeUs - startUs) {
+            virtual_matrix::Set(nextStep->column,
+                                nextStep->row,
+                                nextStep->isPressed);
+            ++nextStep;
+        }
+        Scan();
+        m_timeUs += SCAN_PERIOD_US;
+        s_clockUs += SCAN_PERIOD_US;
+    }
+}
+
+// A matrix task scan, whose events are processed right away, followed by a
+// USB task wake up
+void Simulator::Scan() {
+    m_scanner.Update(matrix_io::Read());
+
+    const uint32_t nowUs = s_clockUs;
+    key_pipeline::Update(nowUs);
+    if (macros::IsPlaying() &&
+        !m_reportScheduler.IsPending(usb_hid::Slot::Keyboard)) {
+        key_pipeline::StepMacro(nowUs);
+    }
+    while (m_reportScheduler.Service()) {
+    }
+}
+
+// Decodes the report into the state the host now sees
+void Simulator::Record(uint8_t reportId, const uint8_t* data, uint8_t size) {
+    switch (reportId) {
+        case usb_hid::KEYBOARD_REPORT_ID: {
+            usb_hid::NkroReport report;
+            memcpy(&report, data, sizeof(report));
+            m_hostState.modifiers = report.modifiers;
+            m_hostState.keys      = report.keys;
+            break;
+        }
+        case usb_hid::CONSUMER_REPORT_ID:
+            memcpy(&m_hostState.consumerCode,
+                   data,
+                   sizeof(m_hostState.consumerCode));
+            break;
+        default:
+            // Boot protocol report, a rollover error keeps the previous keys
+            if (data[2] == usb_hid::ROLLOVER_ERROR) {
+                break;
+            }
+            m_hostState.modifiers = data[0];
+            m_hostState.keys      = {};
+            for (uint8_t i = 2; i < size; ++i) {
+                m_hostState.AddKey(data[i]);
+            }
+            break;
+    }
+    m_reports.push_back({m_timeUs, m_hostState});
+}
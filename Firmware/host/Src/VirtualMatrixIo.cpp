@@ -0,0 +1,47 @@
+#include "MatrixIo.hpp"
+#include "VirtualMatrix.hpp"
+
+// Host backend of matrix_io. Reads return whatever the test has set, there
+// is no settling time nor ghosting.
+
+namespace virtual_matrix {
+
+static KeyBitmap keys;
+
+void Set(uint8_t column, uint8_t row, bool isPressed) {
+    keys.Set(KeyBitmap::Index(column, row), isPressed);
+}
+
+void Clear() {
+    keys = {};
+}
+
+const KeyBitmap& Get() {
+    return keys;
+}
+
+} // namespace virtual_matrix
+
+namespace matrix_io {
+
+bool Init() {
+    return true;
+}
+
+bool SetupPins() {
+    return true;
+}
+
+KeyBitmap Read() {
+    return virtual_matrix::Get();
+}
+
+KeyBitmap ReadPerPin() {
+    return virtual_matrix::Get();
+}
+
+// Nothing would ever press a key while blocked here, the simulator keeps
+// scanning instead
+void WaitForKeyPress() {}
+
+} // namespace matrix_io
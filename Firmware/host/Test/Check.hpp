@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdio>
+
+// Minimal assertions of the host tests. A failed check is printed and the
+// test carries on, main() returns check::Result().
+namespace check {
+
+inline int failures;
+
+inline void Check(bool condition,
+                  const char* text,
+                  const char* file,
+                  int line) {
+    if (!condition) {
+        printf("%s:%d: check failed: %s\n", file, line, text);
+        ++failures;
+    }
+}
+
+inline int Result() {
+    if (failures) {
+        printf("%d checks failed\n", failures);
+    }
+    return failures ? 1 : 0;
+}
+
+} // namespace check
+
+#define CHECK(condition)                                                      \
+    check::Check((condition), #condition, __FILE__, __LINE__)
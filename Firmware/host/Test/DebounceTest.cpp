@@ -0,0 +1,147 @@
+// Synthetic bounce traces fed to every debounce algorithm, one scan per
+// millisecond, with the clock starting at several points so the byte wide
+// per key deadlines and the 32 bit clock both wrap during some runs.
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "Check.hpp"
+#include "Debounce.hpp"
+#include "KeyBitmap.hpp"
+
+using debounce::Algorithm;
+
+static constexpr uint8_t DEBOUNCE_TIME_MS = 5;
+
+static constexpr uint8_t KEY_A = KeyBitmap::Index(0, 0);
+static constexpr uint8_t KEY_B = KeyBitmap::Index(3, 2);
+
+static constexpr std::array<uint32_t, 3> startTimesMs = {
+    0,
+    250,
+    UINT32_MAX - 2,
+};
+
+// Raw level of a key from timeMs on, relative to the start of the trace
+struct Sample {
+    uint32_t timeMs;
+    uint8_t key;
+    bool isPressed;
+};
+
+struct Change {
+    uint32_t timeMs;
+    uint8_t key;
+    bool isPressed;
+
+    bool operator==(const Change&) const = default;
+};
+
+static std::vector<Change> Run(Algorithm algorithm,
+                               uint32_t startMs,
+                               const std::vector<Sample>& samples,
+                               uint32_t durationMs) {
+    debounce::Debouncer debouncer(algorithm, DEBOUNCE_TIME_MS);
+    std::vector<Change> changes;
+    KeyBitmap raw;
+    for (uint32_t timeMs = 0; timeMs < durationMs; ++timeMs) {
+        for (const Sample& sample : samples) {
+            if (sample.timeMs == timeMs) {
+                raw.Set(sample.key, sample.isPressed);
+            }
+        }
+        const KeyBitmap changed = debouncer.Update(raw, startMs + timeMs);
+        changed.ForEach([&](uint8_t key) {
+            changes.push_back({timeMs, key, debouncer.GetState().Test(key)});
+        });
+    }
+    CHECK(!debouncer.IsBusy());
+    CHECK(debouncer.GetState() == raw);
+    return changes;
+}
+
+static void Expect(Algorithm algorithm,
+                   const std::vector<Sample>& samples,
+                   const std::vector<Change>& expected) {
+    for (uint32_t startMs : startTimesMs) {
+        const std::vector<Change> changes =
+            Run(algorithm, startMs, samples, 100);
+        CHECK(changes == expected);
+        if (changes != expected) {
+            printf("  algorithm %u, clock started at %u ms\n",
+                   static_cast<unsigned>(algorithm),
+                   startMs);
+        }
+    }
+}
+
+// Press and release both chatter for 4 ms
+static const std::vector<Sample> bouncyTap = {
+    {0, KEY_A, true},
+    {1, KEY_A, false},
+    {2, KEY_A, true},
+    {3, KEY_A, false},
+    {4, KEY_A, true},
+    {50, KEY_A, false},
+    {51, KEY_A, true},
+    {52, KEY_A, false},
+};
+
+// A single 2 ms pulse, e.g. noise picked up by a long row trace
+static const std::vector<Sample> glitch = {
+    {10, KEY_A, true},
+    {12, KEY_A, false},
+};
+
+static void TestEagerPerKey() {
+    // Reported on the first edge, the chatter falls in the lockout
+    Expect(Algorithm::EagerPerKey,
+           bouncyTap,
+           {{0, KEY_A, true}, {50, KEY_A, false}});
+    // A tap shorter than the lockout is released when the lockout ends
+    Expect(Algorithm::EagerPerKey,
+           {{0, KEY_A, true}, {3, KEY_A, false}},
+           {{0, KEY_A, true}, {5, KEY_A, false}});
+    // Every glitch gets through, the price of reporting at once
+    Expect(Algorithm::EagerPerKey,
+           glitch,
+           {{10, KEY_A, true}, {15, KEY_A, false}});
+    // One key in its lockout does not hold another one back
+    Expect(Algorithm::EagerPerKey,
+           {{0, KEY_A, true}, {1, KEY_A, false}, {2, KEY_B, true}},
+           {{0, KEY_A, true}, {2, KEY_B, true}, {5, KEY_A, false}});
+}
+
+static void TestDeferredPerKey() {
+    // Reported once stable for the debounce time after the last bounce
+    Expect(Algorithm::DeferredPerKey,
+           bouncyTap,
+           {{9, KEY_A, true}, {57, KEY_A, false}});
+    Expect(Algorithm::DeferredPerKey, glitch, {});
+    // Each key settles on its own
+    Expect(Algorithm::DeferredPerKey,
+           {{0, KEY_A, true}, {1, KEY_B, true}, {3, KEY_B, false},
+            {4, KEY_B, true}},
+           {{5, KEY_A, true}, {9, KEY_B, true}});
+}
+
+static void TestDeferredGlobal() {
+    Expect(Algorithm::DeferredGlobal,
+           bouncyTap,
+           {{9, KEY_A, true}, {57, KEY_A, false}});
+    Expect(Algorithm::DeferredGlobal, glitch, {});
+    // Any change restarts the wait for the whole matrix
+    Expect(Algorithm::DeferredGlobal,
+           {{0, KEY_A, true}, {1, KEY_B, true}, {3, KEY_B, false},
+            {4, KEY_B, true}},
+           {{9, KEY_A, true}, {9, KEY_B, true}});
+}
+
+int main() {
+    TestEagerPerKey();
+    TestDeferredPerKey();
+    TestDeferredGlobal();
+    return check::Result();
+}
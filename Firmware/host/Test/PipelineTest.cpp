@@ -0,0 +1,299 @@
+// Key timelines replayed on the virtual matrix through the debouncer and the
+// key pipeline, with the layout of TestLayout.hpp, checking the reports the
+// host would receive and when.
+
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <vector>
+
+#include "Check.hpp"
+#include "Simulator.hpp"
+#include "TestLayout.hpp"
+#include "UsbHid.hpp"
+
+using debounce::Algorithm;
+using namespace test_layout;
+
+static constexpr uint8_t DEBOUNCE_TIME_MS = 5;
+// As set in KeyPipeline.cpp. Terms only expire once no event from before
+// them can still be on its way, a millisecond later.
+static constexpr uint32_t COMBO_TERM_US   = 50000;
+static constexpr uint32_t TAPPING_TERM_US = 200000;
+static constexpr uint32_t TERM_MARGIN_US  = 1000;
+// Length of every timeline, long enough for the terms to expire after the
+// last step. A whole number of milliseconds, so the next timeline starts on
+// the same phase of the debouncer clock.
+static constexpr uint32_t TIMELINE_US = 500000;
+
+static Simulator::Step Press(uint32_t timeUs, Position key) {
+    return {timeUs, key.column, key.row, true};
+}
+
+static Simulator::Step Release(uint32_t timeUs, Position key) {
+    return {timeUs, key.column, key.row, false};
+}
+
+struct Expected {
+    uint32_t timeUs;
+    std::initializer_list<uint8_t> keys;
+    uint8_t modifiers     = 0;
+    uint16_t consumerCode = 0;
+};
+
+static bool Matches(const Simulator::Report& report,
+                    uint32_t startUs,
+                    const Expected& expected) {
+    usb_hid::KbHidReport keys = {};
+    for (uint8_t key : expected.keys) {
+        keys.AddKey(key);
+    }
+    return report.timeUs - startUs == expected.timeUs &&
+           report.report.keys == keys.keys &&
+           report.report.modifiers == expected.modifiers &&
+           report.report.consumerCode == expected.consumerCode;
+}
+
+// Replays the steps on a simulator started afresh, then checks the reports
+// against the expected ones, times being relative to the first step
+static void Expect(Algorithm algorithm,
+                   std::initializer_list<Simulator::Step> steps,
+                   std::vector<Expected> expected,
+                   bool isBootProtocol = false) {
+    Simulator simulator(algorithm, DEBOUNCE_TIME_MS, isBootProtocol);
+    const uint32_t startUs = simulator.GetTime();
+    simulator.Replay(steps, TIMELINE_US);
+
+    const std::vector<Simulator::Report>& reports = simulator.GetReports();
+    bool isMatching = reports.size() == expected.size();
+    for (size_t i = 0; isMatching && i < reports.size(); ++i) {
+        isMatching = Matches(reports[i], startUs, expected[i]);
+    }
+    CHECK(isMatching);
+    if (!isMatching) {
+        printf("  algorithm %u, reports received:\n",
+               static_cast<unsigned>(algorithm));
+        for (const Simulator::Report& report : reports) {
+            printf("    %u: modifiers %02x, consumer %04x, keys",
+                   report.timeUs - startUs,
+                   report.report.modifiers,
+                   report.report.consumerCode);
+            for (uint8_t byte : report.report.keys) {
+                printf(" %02x", byte);
+            }
+            printf("\n");
+        }
+    }
+}
+
+static void TestPressRelease() {
+    for (Algorithm algorithm : {Algorithm::EagerPerKey,
+                                Algorithm::DeferredPerKey,
+                                Algorithm::DeferredGlobal}) {
+        const uint32_t delayUs =
+            algorithm == Algorithm::EagerPerKey ? 0 : DEBOUNCE_TIME_MS * 1000;
+        Expect(algorithm,
+               {Press(0, A), Release(50000, A)},
+               {{delayUs, {HID_KEY_A}}, {50000 + delayUs, {}}});
+    }
+}
+
+// Contacts chattering for about a millisecond on press and release still
+// give one report each
+static void TestChatter() {
+    const std::initializer_list<Simulator::Step> chatter = {
+        Press(0, A),
+        Release(300, A),
+        Press(600, A),
+        Release(900, A),
+        Press(1200, A),
+        Release(50000, A),
+        Press(50300, A),
+        Release(50600, A),
+    };
+    Expect(Algorithm::EagerPerKey,
+           chatter,
+           {{0, {HID_KEY_A}}, {50000, {}}});
+    // Scans every 250 us see the last bounces at 1250 and 50750 us, stable
+    // for 5 ms on the millisecond clock from then
+    Expect(Algorithm::DeferredPerKey,
+           chatter,
+           {{6000, {HID_KEY_A}}, {55000, {}}});
+    Expect(Algorithm::DeferredGlobal,
+           chatter,
+           {{6000, {HID_KEY_A}}, {55000, {}}});
+}
+
+// Changes seen by the same scan share a report, later ones get their own
+static void TestReportGrouping() {
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, LEFTSHIFT),
+            Press(0, A),
+            Release(30000, A),
+            Release(30000, LEFTSHIFT)},
+           {{0, {HID_KEY_A}, KEYBOARD_MODIFIER_LEFTSHIFT}, {30000, {}}});
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, LEFTSHIFT),
+            Press(Simulator::SCAN_PERIOD_US, A),
+            Release(30000, A),
+            Release(30000 + Simulator::SCAN_PERIOD_US, LEFTSHIFT)},
+           {{0, {}, KEYBOARD_MODIFIER_LEFTSHIFT},
+            {Simulator::SCAN_PERIOD_US,
+             {HID_KEY_A},
+             KEYBOARD_MODIFIER_LEFTSHIFT},
+            {30000, {}, KEYBOARD_MODIFIER_LEFTSHIFT},
+            {30000 + Simulator::SCAN_PERIOD_US, {}}});
+}
+
+static void TestFnLayer() {
+    // A key is released as what it was pressed as, even once Fn is up
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, FUNCTION),
+            Press(20000, F1),
+            Release(40000, FUNCTION),
+            Release(60000, F1)},
+           {{20000, {}, 0, HID_USAGE_CONSUMER_MUTE}, {60000, {}}});
+    // Without Fn the same key is F1
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, F1), Release(20000, F1)},
+           {{0, {HID_KEY_F1}}, {20000, {}}});
+    // Fn+L dumps the latency statistics and sends nothing
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, FUNCTION),
+            Press(20000, L),
+            Release(40000, L),
+            Release(60000, FUNCTION)},
+           {});
+}
+
+// The same keys reach a boot protocol host, in the 8 byte report
+static void TestBootProtocol() {
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, LEFTSHIFT),
+            Press(Simulator::SCAN_PERIOD_US, A),
+            Release(30000, A),
+            Release(30000, LEFTSHIFT)},
+           {{0, {}, KEYBOARD_MODIFIER_LEFTSHIFT},
+            {Simulator::SCAN_PERIOD_US,
+             {HID_KEY_A},
+             KEYBOARD_MODIFIER_LEFTSHIFT},
+            {30000, {}}},
+           true);
+}
+
+// Dual-function keys decided by the tapping term, with the margin the
+// pipeline keeps on it
+static void TestTapHold() {
+    // Released within the term, a tap
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, CTRL_ESC), Release(100000, CTRL_ESC)},
+           {{100000, {HID_KEY_ESCAPE}}, {100000, {}}});
+    // Held past the term, decided on the first scan after it
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, CTRL_ESC), Release(300000, CTRL_ESC)},
+           {{TAPPING_TERM_US + TERM_MARGIN_US,
+             {},
+             KEYBOARD_MODIFIER_LEFTCTRL},
+            {300000, {}}});
+    // Another key pressed and released within the term makes it a hold
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, CTRL_ESC),
+            Press(50000, A),
+            Release(100000, A),
+            Release(150000, CTRL_ESC)},
+           {{100000, {}, KEYBOARD_MODIFIER_LEFTCTRL},
+            {100000, {HID_KEY_A}, KEYBOARD_MODIFIER_LEFTCTRL},
+            {100000, {}, KEYBOARD_MODIFIER_LEFTCTRL},
+            {150000, {}}});
+    // Same for a layer, the key pressed within the term uses it
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, SPACE_FN),
+            Press(50000, F1),
+            Release(100000, F1),
+            Release(150000, SPACE_FN)},
+           {{100000, {}, 0, HID_USAGE_CONSUMER_MUTE}, {100000, {}}});
+    // Rolled over, the other key is released after it, a tap
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, SPACE_FN),
+            Press(50000, A),
+            Release(100000, SPACE_FN),
+            Release(150000, A)},
+           {{100000, {HID_KEY_SPACE}},
+            {100000, {HID_KEY_SPACE, HID_KEY_A}},
+            {100000, {HID_KEY_A}},
+            {150000, {}}});
+}
+
+static void TestCombos() {
+    // J and K together, Escape once L can no longer complete the larger
+    // combo. The combo is released with its first key.
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, J),
+            Press(20000, K),
+            Release(100000, J),
+            Release(110000, K)},
+           {{COMBO_TERM_US + TERM_MARGIN_US, {HID_KEY_ESCAPE}},
+            {100000, {}}});
+    // The larger combo is sent as soon as it is complete
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, J),
+            Press(10000, K),
+            Press(20000, L),
+            Release(100000, L),
+            Release(110000, J),
+            Release(110000, K)},
+           {{20000, {HID_KEY_TAB}}, {100000, {}}});
+    // Alone, the key is sent once the term expires
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, J), Release(100000, J)},
+           {{COMBO_TERM_US + TERM_MARGIN_US, {HID_KEY_J}}, {100000, {}}});
+    // Another key ends the combo term, both go out in order
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, J),
+            Press(20000, A),
+            Release(100000, J),
+            Release(100000, A)},
+           {{20000, {HID_KEY_J}}, {20000, {HID_KEY_J, HID_KEY_A}},
+            {100000, {}}});
+}
+
+// A macro plays one step per report, each report taken by the host on the
+// next scan, alongside the keys typed in the meantime
+static void TestMacro() {
+    constexpr uint32_t SCAN_US = Simulator::SCAN_PERIOD_US;
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, MACRO), Release(20000, MACRO)},
+           {{0, {}, KEYBOARD_MODIFIER_LEFTSHIFT},
+            {SCAN_US, {HID_KEY_H}, KEYBOARD_MODIFIER_LEFTSHIFT},
+            {2 * SCAN_US, {}, KEYBOARD_MODIFIER_LEFTSHIFT},
+            {3 * SCAN_US, {}},
+            {4 * SCAN_US, {HID_KEY_I}},
+            {5 * SCAN_US, {}}});
+    Expect(Algorithm::EagerPerKey,
+           {Press(0, A),
+            Press(10000, MACRO),
+            Release(30000, MACRO),
+            Release(40000, A)},
+           {{0, {HID_KEY_A}},
+            {10000, {HID_KEY_A}, KEYBOARD_MODIFIER_LEFTSHIFT},
+            {10000 + SCAN_US,
+             {HID_KEY_A, HID_KEY_H},
+             KEYBOARD_MODIFIER_LEFTSHIFT},
+            {10000 + 2 * SCAN_US, {HID_KEY_A}, KEYBOARD_MODIFIER_LEFTSHIFT},
+            {10000 + 3 * SCAN_US, {HID_KEY_A}},
+            {10000 + 4 * SCAN_US, {HID_KEY_A, HID_KEY_I}},
+            {10000 + 5 * SCAN_US, {HID_KEY_A}},
+            {40000, {}}});
+}
+
+int main() {
+    TestPressRelease();
+    TestChatter();
+    TestReportGrouping();
+    TestFnLayer();
+    TestBootProtocol();
+    TestTapHold();
+    TestCombos();
+    TestMacro();
+    return check::Result();
+}
@@ -0,0 +1,284 @@
+// The keyboard state packed into NKRO and boot protocol reports, and the
+// report slots in front of a fake endpoint that the test makes busy, free or
+// gone, checking every report it is handed.
+
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <vector>
+
+#include "Check.hpp"
+#include "ReportScheduler.hpp"
+#include "UsbHid.hpp"
+
+using usb_hid::KbHidReport;
+using usb_hid::ReportScheduler;
+using usb_hid::Slot;
+
+struct Sent {
+    uint8_t reportId;
+    std::vector<uint8_t> data;
+
+    bool operator==(const Sent&) const = default;
+};
+
+static bool isEndpointFree;
+static bool isHostPresent;
+// The endpoint looks free but refuses every report
+static bool isRefusing;
+static std::vector<Sent> sent;
+
+static bool IsReady() {
+    return isEndpointFree;
+}
+
+// Taking a report keeps the endpoint busy until the host polls it
+static bool Send(uint8_t reportId, const uint8_t* data, uint8_t size) {
+    if (!isEndpointFree || isRefusing) {
+        return false;
+    }
+    isEndpointFree = false;
+    sent.push_back({reportId, std::vector<uint8_t>(data, data + size)});
+    return true;
+}
+
+// The host polls the endpoint while it is waited for, unless it is gone
+static bool WaitReady() {
+    isEndpointFree = isHostPresent;
+    return isHostPresent;
+}
+
+static ReportScheduler MakeScheduler() {
+    isEndpointFree = true;
+    isHostPresent  = true;
+    isRefusing     = false;
+    sent.clear();
+    return ReportScheduler(IsReady, Send, WaitReady);
+}
+
+static KbHidReport MakeReport(std::initializer_list<uint8_t> keys,
+                              uint8_t modifiers     = 0,
+                              uint16_t consumerCode = 0) {
+    KbHidReport report = {};
+    for (uint8_t key : keys) {
+        report.AddKey(key);
+    }
+    report.modifiers    = modifiers;
+    report.consumerCode = consumerCode;
+    return report;
+}
+
+static Sent Nkro(std::initializer_list<uint8_t> keys, uint8_t modifiers = 0) {
+    const KbHidReport report = MakeReport(keys, modifiers);
+    Sent expected            = {usb_hid::KEYBOARD_REPORT_ID, {modifiers}};
+    expected.data.insert(expected.data.end(),
+                         report.keys.begin(),
+                         report.keys.end());
+    return expected;
+}
+
+static Sent Consumer(uint16_t code) {
+    return {usb_hid::CONSUMER_REPORT_ID,
+            {static_cast<uint8_t>(code), static_cast<uint8_t>(code >> 8)}};
+}
+
+static Sent Boot(std::vector<uint8_t> bytes) {
+    return {0, bytes};
+}
+
+// Sends whatever is pending, the host polling between reports
+static void Drain(ReportScheduler& scheduler) {
+    while (WaitReady() && scheduler.Service()) {
+    }
+}
+
+static void ExpectSent(const std::vector<Sent>& expected) {
+    CHECK(sent == expected);
+    if (sent != expected) {
+        printf("  reports sent:\n");
+        for (const Sent& report : sent) {
+            printf("    id %u:", report.reportId);
+            for (uint8_t byte : report.data) {
+                printf(" %02x", byte);
+            }
+            printf("\n");
+        }
+    }
+    sent.clear();
+}
+
+static void TestNkro() {
+    ReportScheduler scheduler = MakeScheduler();
+    CHECK(scheduler.Post(MakeReport({HID_KEY_A, HID_KEY_Z},
+                                    KEYBOARD_MODIFIER_LEFTSHIFT),
+                         false));
+    Drain(scheduler);
+    // The consumer report goes out once, with nothing in it
+    ExpectSent({Nkro({HID_KEY_A, HID_KEY_Z}, KEYBOARD_MODIFIER_LEFTSHIFT),
+                Consumer(0)});
+
+    // The same state again is not a change
+    CHECK(!scheduler.Post(MakeReport({HID_KEY_A, HID_KEY_Z},
+                                     KEYBOARD_MODIFIER_LEFTSHIFT),
+                          false));
+    // Only the report that changed is sent
+    CHECK(scheduler.Post(MakeReport({HID_KEY_A, HID_KEY_Z},
+                                    KEYBOARD_MODIFIER_LEFTSHIFT,
+                                    HID_USAGE_CONSUMER_MUTE),
+                         false));
+    CHECK(!scheduler.IsPending(Slot::Keyboard));
+    CHECK(scheduler.IsPending(Slot::Consumer));
+    Drain(scheduler);
+    ExpectSent({Consumer(HID_USAGE_CONSUMER_MUTE)});
+}
+
+static void TestBoot() {
+    ReportScheduler scheduler = MakeScheduler();
+    // Keys in usage order, without report ID nor consumer report
+    scheduler.Post(MakeReport({HID_KEY_Z, HID_KEY_A, HID_KEY_1},
+                              KEYBOARD_MODIFIER_LEFTCTRL,
+                              HID_USAGE_CONSUMER_MUTE),
+                   true);
+    Drain(scheduler);
+    ExpectSent({Boot({KEYBOARD_MODIFIER_LEFTCTRL,
+                      0,
+                      HID_KEY_A,
+                      HID_KEY_Z,
+                      HID_KEY_1,
+                      0,
+                      0,
+                      0})});
+
+    // Six keys fit, a seventh is a rollover error in every key byte
+    scheduler.Post(MakeReport({HID_KEY_A,
+                               HID_KEY_B,
+                               HID_KEY_C,
+                               HID_KEY_D,
+                               HID_KEY_E,
+                               HID_KEY_F}),
+                   true);
+    scheduler.Post(MakeReport({HID_KEY_A,
+                               HID_KEY_B,
+                               HID_KEY_C,
+                               HID_KEY_D,
+                               HID_KEY_E,
+                               HID_KEY_F,
+                               HID_KEY_G},
+                              KEYBOARD_MODIFIER_LEFTSHIFT),
+                   true);
+    Drain(scheduler);
+    ExpectSent({Boot({0,
+                      0,
+                      HID_KEY_A,
+                      HID_KEY_B,
+                      HID_KEY_C,
+                      HID_KEY_D,
+                      HID_KEY_E,
+                      HID_KEY_F}),
+                Boot({KEYBOARD_MODIFIER_LEFTSHIFT,
+                      0,
+                      usb_hid::ROLLOVER_ERROR,
+                      usb_hid::ROLLOVER_ERROR,
+                      usb_hid::ROLLOVER_ERROR,
+                      usb_hid::ROLLOVER_ERROR,
+                      usb_hid::ROLLOVER_ERROR,
+                      usb_hid::ROLLOVER_ERROR})});
+
+    // Back in report protocol the same state is posted as NKRO
+    CHECK(scheduler.Post(MakeReport({}), false));
+    Drain(scheduler);
+    ExpectSent({Nkro({}), Consumer(0)});
+}
+
+// A change posted while the previous one is still pending sends the previous
+// one first, so a press and its release are never merged away
+static void TestMerging() {
+    ReportScheduler scheduler = MakeScheduler();
+    scheduler.Post(MakeReport({}), false);
+    Drain(scheduler);
+    sent.clear();
+
+    isEndpointFree = false;
+    scheduler.Post(MakeReport({HID_KEY_A}), false);
+    CHECK(!scheduler.Service());
+    scheduler.Post(MakeReport({}), false);
+    ExpectSent({Nkro({HID_KEY_A})});
+    CHECK(scheduler.IsPending(Slot::Keyboard));
+    Drain(scheduler);
+    ExpectSent({Nkro({})});
+}
+
+// The keyboard report is sent before the consumer one
+static void TestPriority() {
+    ReportScheduler scheduler = MakeScheduler();
+    scheduler.Post(MakeReport({}), false);
+    Drain(scheduler);
+    sent.clear();
+
+    scheduler.Post(MakeReport({HID_KEY_A}, 0, HID_USAGE_CONSUMER_MUTE), false);
+    CHECK(scheduler.Service());
+    CHECK(!scheduler.Service());
+    ExpectSent({Nkro({HID_KEY_A})});
+    CHECK(scheduler.IsPending(Slot::Consumer));
+    Drain(scheduler);
+    ExpectSent({Consumer(HID_USAGE_CONSUMER_MUTE)});
+}
+
+static void TestHostGone() {
+    ReportScheduler scheduler = MakeScheduler();
+    scheduler.Post(MakeReport({}), false);
+    Drain(scheduler);
+    sent.clear();
+
+    // Nothing waits for a host that is gone, the pending state is replaced
+    isEndpointFree = false;
+    isHostPresent  = false;
+    scheduler.Post(MakeReport({HID_KEY_A}), false);
+    scheduler.Post(MakeReport({HID_KEY_B}), false);
+    ExpectSent({});
+
+    // Once reset, the current state goes out whatever the host had before
+    isHostPresent = true;
+    scheduler.Reset();
+    CHECK(!scheduler.IsAnyPending());
+    CHECK(scheduler.Post(MakeReport({HID_KEY_B}), false));
+    Drain(scheduler);
+    ExpectSent({Nkro({HID_KEY_B}), Consumer(0)});
+}
+
+// A ready endpoint that refuses the reports does not hang the post that
+// flushes, the pending reports are dropped instead
+static void TestSendFails() {
+    ReportScheduler scheduler = MakeScheduler();
+    scheduler.Post(MakeReport({}), false);
+    Drain(scheduler);
+    sent.clear();
+
+    isRefusing = true;
+    scheduler.Post(MakeReport({HID_KEY_A}, 0, HID_USAGE_CONSUMER_MUTE), false);
+    CHECK(!scheduler.Service());
+    CHECK(!scheduler.Flush());
+    CHECK(!scheduler.IsAnyPending());
+    // Posting over a pending slot flushes it, which gives up the same way
+    scheduler.Post(MakeReport({HID_KEY_A}), false);
+    CHECK(scheduler.Post(MakeReport({HID_KEY_B}), false));
+    CHECK(scheduler.IsPending(Slot::Keyboard));
+    ExpectSent({});
+
+    // Once the endpoint takes reports again the slot left pending goes out,
+    // and the dropped mute, never seen by the host, is not released
+    isRefusing = false;
+    CHECK(scheduler.Post(MakeReport({}), false));
+    Drain(scheduler);
+    ExpectSent({Nkro({HID_KEY_B}), Nkro({})});
+}
+
+int main() {
+    TestNkro();
+    TestBoot();
+    TestMerging();
+    TestPriority();
+    TestHostGone();
+    TestSendFails();
+    return check::Result();
+}
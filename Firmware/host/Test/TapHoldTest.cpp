@@ -0,0 +1,262 @@
+// Scripted event timelines fed to the tap-hold engine in every mode. The
+// driver calls Update() exactly at the deadline, as the USB task wakes up
+// for it, so each decision can be checked against the time it was taken.
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "Check.hpp"
+#include "KeyEvent.hpp"
+#include "TapHold.hpp"
+
+using tap_hold::Mode;
+
+static constexpr uint16_t TAPPING_TERM_MS = 200;
+static constexpr uint32_t TERM_US         = TAPPING_TERM_MS * 1000;
+
+static constexpr uint8_t TAP_HOLD_KEY   = 0;
+static constexpr uint8_t KEY_A          = 1;
+static constexpr uint8_t TAP_HOLD_KEY_B = 100;
+
+static constexpr std::array<uint32_t, 2> startTimesUs = {
+    0,
+    UINT32_MAX - 100000,
+};
+
+struct Step {
+    uint32_t timeUs;
+    uint8_t key;
+    bool isPressed;
+};
+
+// Event given to the rest of the pipeline and when it was given
+struct Output {
+    uint32_t timeUs;
+    uint16_t key;
+    bool isPressed;
+    bool isHold;
+
+    bool operator==(const Output&) const = default;
+};
+
+static uint32_t startUs;
+static uint32_t nowUs;
+static std::vector<Output> outputs;
+
+static bool IsTapHoldKey(uint8_t key) {
+    return key == TAP_HOLD_KEY || key == TAP_HOLD_KEY_B;
+}
+
+static void Record(const KeyEvent& event, bool isHold) {
+    // Only the tap-hold keys carry a decision
+    outputs.push_back({nowUs - startUs,
+                       event.key,
+                       event.isPressed,
+                       IsTapHoldKey(event.key) && isHold});
+}
+
+static std::vector<Output> Run(Mode mode,
+                               const std::vector<Step>& steps,
+                               uint32_t durationUs) {
+    tap_hold::TapHold tapHold(mode, TAPPING_TERM_MS, IsTapHoldKey, Record);
+    outputs.clear();
+
+    auto runUntil = [&](uint32_t timeUs) {
+        while (tapHold.IsPending() &&
+               tapHold.GetDeadline() - startUs <= timeUs) {
+            nowUs = tapHold.GetDeadline();
+            tapHold.Update(nowUs);
+        }
+    };
+    for (const Step& step : steps) {
+        runUntil(step.timeUs);
+        nowUs = startUs + step.timeUs;
+        tapHold.Process({
+            .timestamp = nowUs,
+            .key       = step.key,
+            .isPressed = step.isPressed,
+        });
+    }
+    runUntil(durationUs);
+    CHECK(!tapHold.IsPending());
+    return outputs;
+}
+
+static void Expect(Mode mode,
+                   const std::vector<Step>& steps,
+                   const std::vector<Output>& expected) {
+    for (uint32_t start : startTimesUs) {
+        startUs                            = start;
+        const std::vector<Output> received = Run(mode, steps, 1000000);
+        CHECK(received == expected);
+        if (received != expected) {
+            printf("  mode %u, clock started at %u us\n",
+                   static_cast<unsigned>(mode),
+                   start);
+            for (const Output& output : received) {
+                printf("    %u: key %u %s%s\n",
+                       output.timeUs,
+                       output.key,
+                       output.isPressed ? "pressed" : "released",
+                       output.isHold ? " held" : "");
+            }
+        }
+    }
+}
+
+static constexpr std::array<Mode, 3> modes = {
+    Mode::TappingTerm,
+    Mode::PermissiveHold,
+    Mode::HoldOnOtherKeyPress,
+};
+
+static void TestAlone() {
+    for (Mode mode : modes) {
+        // Tap, decided on the release
+        Expect(mode,
+               {{0, TAP_HOLD_KEY, true}, {120000, TAP_HOLD_KEY, false}},
+               {{120000, TAP_HOLD_KEY, true, false},
+                {120000, TAP_HOLD_KEY, false, false}});
+        // Hold, decided when the term expires and not on the next event
+        Expect(mode,
+               {{0, TAP_HOLD_KEY, true}, {300000, TAP_HOLD_KEY, false}},
+               {{TERM_US, TAP_HOLD_KEY, true, true},
+                {300000, TAP_HOLD_KEY, false, true}});
+        // The term is exact to the microsecond
+        Expect(mode,
+               {{0, TAP_HOLD_KEY, true}, {TERM_US - 1, TAP_HOLD_KEY, false}},
+               {{TERM_US - 1, TAP_HOLD_KEY, true, false},
+                {TERM_US - 1, TAP_HOLD_KEY, false, false}});
+        Expect(mode,
+               {{0, TAP_HOLD_KEY, true}, {TERM_US, TAP_HOLD_KEY, false}},
+               {{TERM_US, TAP_HOLD_KEY, true, true},
+                {TERM_US, TAP_HOLD_KEY, false, true}});
+    }
+}
+
+// Another key pressed and released within the term
+static void TestNested() {
+    const std::vector<Step> nested = {
+        {0, TAP_HOLD_KEY, true},
+        {50000, KEY_A, true},
+        {80000, KEY_A, false},
+        {120000, TAP_HOLD_KEY, false},
+    };
+    Expect(Mode::TappingTerm,
+           nested,
+           {{120000, TAP_HOLD_KEY, true, false},
+            {120000, KEY_A, true, false},
+            {120000, KEY_A, false, false},
+            {120000, TAP_HOLD_KEY, false, false}});
+    Expect(Mode::PermissiveHold,
+           nested,
+           {{80000, TAP_HOLD_KEY, true, true},
+            {80000, KEY_A, true, false},
+            {80000, KEY_A, false, false},
+            {120000, TAP_HOLD_KEY, false, true}});
+    Expect(Mode::HoldOnOtherKeyPress,
+           nested,
+           {{50000, TAP_HOLD_KEY, true, true},
+            {50000, KEY_A, true, false},
+            {80000, KEY_A, false, false},
+            {120000, TAP_HOLD_KEY, false, true}});
+}
+
+// Fast typing: the other key is released after the tap-hold key
+static void TestRolling() {
+    const std::vector<Step> rolling = {
+        {0, TAP_HOLD_KEY, true},
+        {50000, KEY_A, true},
+        {100000, TAP_HOLD_KEY, false},
+        {150000, KEY_A, false},
+    };
+    const std::vector<Output> tap = {
+        {100000, TAP_HOLD_KEY, true, false},
+        {100000, KEY_A, true, false},
+        {100000, TAP_HOLD_KEY, false, false},
+        {150000, KEY_A, false, false},
+    };
+    Expect(Mode::TappingTerm, rolling, tap);
+    Expect(Mode::PermissiveHold, rolling, tap);
+    Expect(Mode::HoldOnOtherKeyPress,
+           rolling,
+           {{50000, TAP_HOLD_KEY, true, true},
+            {50000, KEY_A, true, false},
+            {100000, TAP_HOLD_KEY, false, true},
+            {150000, KEY_A, false, false}});
+}
+
+// A second tap-hold key pressed while the first is pending, then the first
+// released: the replay starts a decision on the second one, and the release
+// of the first must wait behind its press
+static void TestTwoTapHoldKeys() {
+    const std::vector<Step> steps = {
+        {0, TAP_HOLD_KEY, true},
+        {50000, TAP_HOLD_KEY_B, true},
+        {100000, TAP_HOLD_KEY, false},
+        {150000, TAP_HOLD_KEY_B, false},
+    };
+    const std::vector<Output> taps = {
+        {100000, TAP_HOLD_KEY, true, false},
+        {150000, TAP_HOLD_KEY_B, true, false},
+        {150000, TAP_HOLD_KEY, false, false},
+        {150000, TAP_HOLD_KEY_B, false, false},
+    };
+    Expect(Mode::TappingTerm, steps, taps);
+    Expect(Mode::PermissiveHold, steps, taps);
+    Expect(Mode::HoldOnOtherKeyPress,
+           steps,
+           {{50000, TAP_HOLD_KEY, true, true},
+            {150000, TAP_HOLD_KEY_B, true, false},
+            {150000, TAP_HOLD_KEY, false, true},
+            {150000, TAP_HOLD_KEY_B, false, false}});
+
+    // Same when the first decision is forced by a full buffer: the event that
+    // did not fit goes behind the second decision too
+    constexpr uint8_t EVENTS_NUM = tap_hold::TapHold::BUFFER_SIZE;
+    constexpr uint32_t FULL_US   = (EVENTS_NUM + 1) * 1000;
+    constexpr uint32_t B_TERM_US = 1000 + TERM_US;
+
+    std::vector<Step> overflow   = {{0, TAP_HOLD_KEY, true},
+                                   {1000, TAP_HOLD_KEY_B, true}};
+    std::vector<Output> expected = {{FULL_US, TAP_HOLD_KEY, true, true},
+                                    {B_TERM_US, TAP_HOLD_KEY_B, true, true}};
+    for (uint8_t i = 0; i < EVENTS_NUM; ++i) {
+        const uint8_t key    = KEY_A + i / 2;
+        const bool isPressed = i % 2 == 0;
+        overflow.push_back({(i + 2) * 1000u, key, isPressed});
+        expected.push_back({B_TERM_US, key, isPressed, false});
+    }
+    overflow.push_back({300000, TAP_HOLD_KEY, false});
+    overflow.push_back({300000, TAP_HOLD_KEY_B, false});
+    expected.push_back({300000, TAP_HOLD_KEY, false, true});
+    expected.push_back({300000, TAP_HOLD_KEY_B, false, true});
+    Expect(Mode::TappingTerm, overflow, expected);
+}
+
+// More events than the buffer holds force a hold instead of being dropped
+static void TestBufferFull() {
+    constexpr uint8_t EVENTS_NUM = tap_hold::TapHold::BUFFER_SIZE + 1;
+    constexpr uint32_t FULL_US   = EVENTS_NUM * 1000;
+
+    std::vector<Step> steps      = {{0, TAP_HOLD_KEY, true}};
+    std::vector<Output> expected = {{FULL_US, TAP_HOLD_KEY, true, true}};
+    for (uint8_t i = 0; i < EVENTS_NUM; ++i) {
+        const uint8_t key    = KEY_A + i / 2;
+        const bool isPressed = i % 2 == 0;
+        steps.push_back({(i + 1) * 1000u, key, isPressed});
+        expected.push_back({FULL_US, key, isPressed, false});
+    }
+    Expect(Mode::TappingTerm, steps, expected);
+}
+
+int main() {
+    TestAlone();
+    TestNested();
+    TestRolling();
+    TestTwoTapHoldKeys();
+    TestBufferFull();
+    return check::Result();
+}
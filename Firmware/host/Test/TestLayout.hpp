@@ -0,0 +1,192 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "Combo.hpp"
+#include "Key.hpp"
+#include "KeyBitmap.hpp"
+#include "Macro.hpp"
+
+// Layout of the pipeline tests, included by Layout.hpp in place of the real
+// one. Has the size of the real matrix, and each key the tests use sits where
+// the real layout has the same or a similar key, the others do nothing.
+
+// Matrix positions of the keys, for the tests to press them
+namespace test_layout {
+
+struct Position {
+    uint8_t column;
+    uint8_t row;
+
+    constexpr bool operator==(const Position&) const = default;
+};
+
+static constexpr Position F1        = {1, 0};
+// Escape when tapped, left control when held
+static constexpr Position CTRL_ESC  = {0, 3};
+static constexpr Position A         = {1, 3};
+static constexpr Position LEFTSHIFT = {0, 4};
+static constexpr Position FUNCTION  = {1, 5};
+// Space when tapped, Fn layer when held
+static constexpr Position SPACE_FN  = {6, 5};
+// Escape when pressed together, Tab with L
+static constexpr Position J         = {7, 3};
+static constexpr Position K         = {8, 3};
+static constexpr Position L         = {9, 3};
+// Plays the macro typing "Hi"
+static constexpr Position MACRO     = {13, 0};
+
+} // namespace test_layout
+
+namespace layout {
+
+static constexpr uint8_t ROWS_NUM    = 6;
+static constexpr uint8_t COLUMNS_NUM = 15;
+static constexpr uint8_t LAYERS_NUM  = 2;
+
+static constexpr uint8_t MACROS_NUM  = 1;
+// Enough for the combos the tests press to have indices past 8 bits
+static constexpr uint16_t COMBOS_NUM = 300;
+
+static constexpr uint8_t BASE_LAYER = 0;
+static constexpr uint8_t FN_LAYER   = 1;
+
+using Layer = std::array<std::array<Key, ROWS_NUM>, COLUMNS_NUM>;
+
+static constexpr Key TRNS = Key::Transparent();
+static constexpr Key NONE = Key("NONE", HID_KEY_NONE);
+
+template <typename KeyAt, std::size_t... ROWS>
+constexpr std::array<Key, ROWS_NUM> MakeColumn(KeyAt keyAt,
+                                               uint8_t column,
+                                               std::index_sequence<ROWS...>) {
+    return {{keyAt(test_layout::Position{column, ROWS})...}};
+}
+
+template <typename KeyAt, std::size_t... COLUMNS>
+constexpr Layer MakeLayer(KeyAt keyAt, std::index_sequence<COLUMNS...>) {
+    return {{MakeColumn(keyAt,
+                        COLUMNS,
+                        std::make_index_sequence<ROWS_NUM>())...}};
+}
+
+// Builds a layer from the key at every position
+template <typename KeyAt>
+constexpr Layer MakeLayer(KeyAt keyAt) {
+    return MakeLayer(keyAt, std::make_index_sequence<COLUMNS_NUM>());
+}
+
+inline constexpr std::array<Layer, LAYERS_NUM> layers = {{
+    MakeLayer([](test_layout::Position position) {
+        using namespace test_layout;
+        if (position == F1) {
+            return Key("F1", HID_KEY_F1);
+        }
+        if (position == CTRL_ESC) {
+            return Key::ModTap("CTRL_ESC",
+                               KEYBOARD_MODIFIER_LEFTCTRL,
+                               HID_KEY_ESCAPE);
+        }
+        if (position == A) {
+            return Key("A", HID_KEY_A);
+        }
+        if (position == LEFTSHIFT) {
+            return Key("LEFTSHIFT", KEYBOARD_MODIFIER_LEFTSHIFT);
+        }
+        if (position == FUNCTION) {
+            return Key::Layer("FUNCTION", KeyType::LayerMomentary, FN_LAYER);
+        }
+        if (position == SPACE_FN) {
+            return Key::LayerTap("SPACE_FN", FN_LAYER, HID_KEY_SPACE);
+        }
+        if (position == J) {
+            return Key("J", HID_KEY_J);
+        }
+        if (position == K) {
+            return Key("K", HID_KEY_K);
+        }
+        if (position == L) {
+            return Key("L", HID_KEY_L);
+        }
+        if (position == MACRO) {
+            return Key::Macro("MACRO", 0);
+        }
+        return NONE;
+    }),
+    MakeLayer([](test_layout::Position position) {
+        using namespace test_layout;
+        if (position == F1) {
+            return Key::Consumer("MUTE", HID_USAGE_CONSUMER_MUTE);
+        }
+        if (position == L) {
+            return Key::DoAction("LATENCY", Action::PrintLatency);
+        }
+        return TRNS;
+    }),
+}};
+
+// Pairs of keys from rows 1 and 2, which the tests never press
+constexpr KeyBitmap MakeFillerKeys(std::size_t index) {
+    constexpr uint8_t POSITIONS_NUM = 2 * COLUMNS_NUM;
+    std::size_t pair                = 0;
+    for (uint8_t first = 0; first < POSITIONS_NUM; ++first) {
+        for (uint8_t second = first + 1; second < POSITIONS_NUM; ++second) {
+            if (pair++ == index) {
+                return {KeyBitmap::Index(first % COLUMNS_NUM,
+                                         1 + first / COLUMNS_NUM),
+                        KeyBitmap::Index(second % COLUMNS_NUM,
+                                         1 + second / COLUMNS_NUM)};
+            }
+        }
+    }
+    return {};
+}
+
+// The combos the tests press come last, one inside the other so pressing J
+// and K waits for L
+constexpr Combo MakeCombo(std::size_t index) {
+    using namespace test_layout;
+    if (index == COMBOS_NUM - 2) {
+        return {{KeyBitmap::Index(J.column, J.row),
+                 KeyBitmap::Index(K.column, K.row)},
+                Key("ESCAPE", HID_KEY_ESCAPE)};
+    }
+    if (index == COMBOS_NUM - 1) {
+        return {{KeyBitmap::Index(J.column, J.row),
+                 KeyBitmap::Index(K.column, K.row),
+                 KeyBitmap::Index(L.column, L.row)},
+                Key("TAB", HID_KEY_TAB)};
+    }
+    return {MakeFillerKeys(index), Key("F12", HID_KEY_F12)};
+}
+
+template <std::size_t... INDEXES>
+constexpr std::array<Combo, COMBOS_NUM> MakeCombos(
+    std::index_sequence<INDEXES...>) {
+    return {{MakeCombo(INDEXES)...}};
+}
+
+inline constexpr std::array<Combo, COMBOS_NUM> combos =
+    MakeCombos(std::make_index_sequence<COMBOS_NUM>());
+
+// Every kind of step, each one a report of its own
+inline constexpr uint8_t hiMacro[] = {
+    MACRO_MODIFIERS,
+    KEYBOARD_MODIFIER_LEFTSHIFT,
+    MACRO_TAP,
+    HID_KEY_H,
+    MACRO_MODIFIERS,
+    0,
+    MACRO_PRESS,
+    HID_KEY_I,
+    MACRO_RELEASE,
+    HID_KEY_I,
+    MACRO_END,
+};
+
+inline constexpr std::array<const uint8_t*, MACROS_NUM> macros = {hiMacro};
+
+} // namespace layout
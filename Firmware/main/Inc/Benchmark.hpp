@@ -0,0 +1,26 @@
+#pragma once
+
+#include <sdkconfig.h>
+
+namespace benchmark {
+
+#ifdef CONFIG_KEYBOARD_BENCHMARK
+
+// Measures the hot path pieces one after the other and prints one CSV line
+// per benchmark: bench,<name>,<iterations>,<min>,<average>, in CPU cycles on
+// target and in nanoseconds on the host. Must run before the tasks start, it
+// uses the keymap and the matrix.
+void Run();
+
+// The part of Run() that also builds for the host: debouncer, scan step,
+// keymap and event ring
+void RunPortable();
+
+#else
+
+inline void Run() {}
+inline void RunPortable() {}
+
+#endif
+
+} // namespace benchmark
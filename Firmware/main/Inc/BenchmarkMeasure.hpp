@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+
+#ifdef ESP_PLATFORM
+#include <esp_cpu.h>
+#else
+#include <chrono>
+#endif
+
+namespace benchmark {
+
+// CPU cycles on target, nanoseconds on the host
+inline uint32_t GetTicks() {
+#ifdef ESP_PLATFORM
+    return esp_cpu_get_cycle_count();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+// Runs function iterations times and prints its cost. The cost of reading the
+// clock is not subtracted, it is a few cycles.
+template <typename Function>
+void Measure(const char* name, uint32_t iterations, Function function) {
+    uint32_t min   = UINT32_MAX;
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < iterations; ++i) {
+        const uint32_t start = GetTicks();
+        function();
+        const uint32_t ticks = GetTicks() - start;
+        total += ticks;
+        if (ticks < min) {
+            min = ticks;
+        }
+    }
+    printf("bench,%s,%" PRIu32 ",%" PRIu32 ",%" PRIu32 "\n",
+           name,
+           iterations,
+           min,
+           static_cast<uint32_t>(total / iterations));
+}
+
+} // namespace benchmark
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Key.hpp"
+#include "KeyBitmap.hpp"
+
+// Keys pressed together that act as another key, e.g. J and K for Escape:
+//
+//   {{KeyBitmap::Index(7, 3), KeyBitmap::Index(8, 3)},
+//    Key("ESCAPE", HID_KEY_ESCAPE)}
+//
+// Positions are matrix positions, so a combo works on every layer.
+// Dual-function keys always act as tapped. A combo event carries the index
+// of the combo as its key, so a table may hold up to 65535 of them.
+struct Combo {
+    KeyBitmap keys;
+    Key key;
+};
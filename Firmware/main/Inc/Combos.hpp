@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "KeyBitmap.hpp"
+#include "KeyEvent.hpp"
+#include "Layout.hpp"
+
+namespace combos {
+
+// Turns keys of layout::combos pressed together within the combo term into
+// combo events. Presses of keys that belong to some combo are held back
+// until they either complete a combo or can no longer do so, then replayed
+// in order.
+//
+// Every combo is matched with bitmask tests against the keys held back.
+// Each key has the precomputed set of combos it belongs to, so a press only
+// narrows the candidates down instead of walking the combo table.
+class ComboDetector {
+  public:
+    using Output = void (*)(const KeyEvent& event);
+
+    static constexpr uint8_t BUFFER_SIZE = 8;
+    // Combos that can be held down at the same time
+    static constexpr uint8_t ACTIVE_MAX = 4;
+
+    ComboDetector(uint16_t termMs, Output output);
+
+    void Process(const KeyEvent& event);
+
+    // Ends the combo term if it has expired at nowUs
+    void Update(uint32_t nowUs);
+
+    bool IsPending() const {
+        return m_bufferSize;
+    }
+
+    // Time at which Update() must be called, only valid while pending
+    uint32_t GetDeadline() const {
+        return m_buffer[0].timestamp + m_termUs;
+    }
+
+  private:
+    static constexpr uint16_t WORDS_NUM = (layout::COMBOS_NUM + 31) / 32;
+    using ComboSet                      = std::array<uint32_t, WORDS_NUM>;
+
+    // Fires the combo matching the held back keys if any, replays them
+    // otherwise
+    void Resolve();
+    bool IsExpired(uint32_t nowUs) const;
+    int32_t FindComboMatch(bool& isLargerPossible) const;
+    bool Fire(uint16_t combo);
+    bool ProcessActiveRelease(const KeyEvent& event);
+
+    const uint32_t m_termUs;
+    const Output m_output;
+
+    std::array<KeyEvent, BUFFER_SIZE> m_buffer = {};
+    uint8_t m_bufferSize                       = 0;
+    // Keys held back and combos that contain all of them
+    KeyBitmap m_bufferedKeys;
+    ComboSet m_candidates = {};
+
+    struct ActiveCombo {
+        uint16_t combo;
+        // Keys of the combo still held down
+        KeyBitmap keys;
+        bool isPressed;
+    };
+    std::array<ActiveCombo, ACTIVE_MAX> m_active = {};
+};
+
+} // namespace combos
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "KeyBitmap.hpp"
+
+#include <array>
+#include <cstdint>
+
+namespace debounce {
+
+enum class Algorithm : uint8_t {
+    // Report a change as soon as it is seen, then ignore the key for the
+    // debounce time. Lowest latency, needs switches that never glitch.
+    EagerPerKey = 0,
+    // Report a change once the key has been stable for the debounce time
+    DeferredPerKey,
+    // Report all changes once the whole matrix has been stable for the
+    // debounce time
+    DeferredGlobal,
+};
+
+// Independent of ESP-IDF so it can be exercised on the host with recorded or
+// synthetic bounce traces.
+class Debouncer {
+  public:
+    // Per key timers are stored as the low byte of a millisecond timestamp
+    static constexpr uint8_t MAX_TIME_MS = 127;
+
+    Debouncer(Algorithm algorithm, uint8_t timeMs);
+
+    // Feeds a raw scan taken at nowMs and returns the keys whose debounced
+    // state changed
+    KeyBitmap Update(const KeyBitmap& raw, uint32_t nowMs);
+
+    const KeyBitmap& GetState() const {
+        return m_state;
+    }
+
+    // Whether a change may still be reported without the raw state changing,
+    // in which case the matrix must keep being scanned
+    bool IsBusy() const {
+        return m_busy.Any() || m_globalBusy;
+    }
+
+  private:
+    KeyBitmap UpdateEagerPerKey(const KeyBitmap& raw, uint32_t nowMs);
+    KeyBitmap UpdateDeferredPerKey(const KeyBitmap& raw, uint32_t nowMs);
+    KeyBitmap UpdateDeferredGlobal(const KeyBitmap& raw, uint32_t nowMs);
+
+    void StartTimers(const KeyBitmap& keys, uint32_t nowMs);
+    KeyBitmap ExpiredTimers(uint32_t nowMs) const;
+
+    const Algorithm m_algorithm;
+    const uint8_t m_timeMs;
+
+    KeyBitmap m_state;
+    KeyBitmap m_lastRaw;
+    // Keys with a running timer
+    KeyBitmap m_busy;
+    std::array<uint8_t, KeyBitmap::SIZE> m_deadlines = {};
+
+    bool m_globalBusy = false;
+    uint32_t m_globalDeadline = 0;
+};
+
+} // namespace debounce
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+#include <esp_log.h>
+
+// Logging for the latency critical paths. A log call only copies a message
+// id and its raw arguments into a ring, in constant time, and a low priority
+// task formats and prints them later.
+//
+// Every subsystem has its own ring, so each one must only log from a single
+// task and never from an interrupt.
+namespace deferred_log {
+
+enum class Subsystem : uint8_t {
+    Matrix = 0,
+    UsbHid,
+};
+static constexpr uint8_t SUBSYSTEMS_NUM = 2;
+
+enum class Message : uint8_t {
+    // Matrix: key index, whether it is pressed
+    KeyChanged = 0,
+    // UsbHid: bytes of the report
+    ReportSent,
+};
+
+// Messages below level are dropped before being recorded. Defaults to
+// ESP_LOG_INFO.
+void SetLevel(Subsystem subsystem, esp_log_level_t level);
+
+void Log(Message message, uint32_t arg0 = 0, uint32_t arg1 = 0);
+void LogBytes(Message message, const void* data, uint8_t size);
+
+// Drops everything recorded so far without printing it. Only for use before
+// the drain task starts, e.g. after benchmarking the log calls.
+void Discard();
+
+bool SetupTask();
+
+} // namespace deferred_log
@@ -3,72 +3,142 @@
 #include <class/hid/hid_device.h>
 #include <cstdint>
 
+enum class KeyType : uint8_t {
+    // Does nothing, also hides the keys of the layers below
+    None = 0,
+    // Uses the key of the next active layer below
+    Transparent,
+    Keyboard,
+    Modifier,
+    Consumer,
+    Action,
+    // Plays one of layout::macros
+    Macro,
+    // Modifier while held, keyboard usage when tapped
+    ModTap,
+    // Momentary layer while held, keyboard usage when tapped
+    LayerTap,
+    // Layer active while the key is held
+    LayerMomentary,
+    // Layer switched on or off on every press
+    LayerToggle,
+    // Layer active for the next key press only
+    LayerOneShot,
+    // Layer used when no other one is active
+    LayerDefault,
+};
+
+// Things a key can do besides sending HID codes
+enum class Action : uint8_t {
+    None = 0,
+    DecreaseBrightness,
+    IncreaseBrightness,
+    // Logs the latency statistics, when compiled in
+    PrintLatency,
+};
+
+// Layout entry of a key in one layer. Only holds constant data so the whole
+// layout can be built at compile time and kept in flash, the state of the
+// keys lives in the modules that scan and process them.
 class Key {
   public:
-    using FnFunction = void (*)(bool);
+    constexpr Key(const char* keyText, uint8_t hidCode)
+        : Key(keyText, hidCode ? KeyType::Keyboard : KeyType::None, hidCode) {}
 
-    Key(const char* keyText,
-        uint8_t hidCode,
-        uint8_t fnCode         = 0,
-        uint8_t fnConsumerCode = 0,
-        FnFunction fnFunction  = nullptr)
-        : m_keyText(keyText),
-          m_modifier(0),
-          m_hidCode(hidCode),
-          m_fnKeyCode(fnCode),
-          m_fnConsumerCode(fnConsumerCode),
-          m_fnFunction(fnFunction),
-          m_state(false) {}
-
-    Key(const char* keyText, hid_keyboard_modifier_bm_t modifier)
-        : m_keyText(keyText),
-          m_modifier(modifier),
-          m_hidCode(0),
-          m_fnKeyCode(0),
-          m_fnConsumerCode(0),
-          m_fnFunction(nullptr),
-          m_state(false) {}
-
-    const char* GetText() {
-        return m_keyText;
+    constexpr Key(const char* keyText, hid_keyboard_modifier_bm_t modifier)
+        : Key(keyText, KeyType::Modifier, modifier) {}
+
+    static constexpr Key Transparent() {
+        return Key("TRANSPARENT", KeyType::Transparent, 0);
+    }
+
+    static constexpr Key Consumer(const char* keyText, uint16_t usage) {
+        return Key(keyText, KeyType::Consumer, usage);
     }
 
-    uint8_t GetCode() const {
-        return m_hidCode;
+    static constexpr Key DoAction(const char* keyText, Action action) {
+        return Key(keyText, KeyType::Action, static_cast<uint16_t>(action));
     }
 
-    uint8_t GetFnKeyCode() const {
-        return m_fnKeyCode;
+    static constexpr Key Macro(const char* keyText, uint8_t macro) {
+        return Key(keyText, KeyType::Macro, macro);
     }
 
-    uint8_t GetFnConsumerCode() const {
-        return m_fnConsumerCode;
+    // type must be one of the Layer* types
+    static constexpr Key Layer(const char* keyText,
+                               KeyType type,
+                               uint8_t layer) {
+        return Key(keyText, type, layer);
     }
 
-    uint8_t GetModifier() const {
-        return m_modifier;
+    // Dual-function keys, e.g. ModTap("CTRL_ESC", KEYBOARD_MODIFIER_LEFTCTRL,
+    // HID_KEY_ESCAPE) on Caps Lock. The tap usage is kept in the low byte.
+    static constexpr Key ModTap(const char* keyText,
+                                hid_keyboard_modifier_bm_t modifier,
+                                uint8_t hidCode) {
+        return Key(keyText, KeyType::ModTap, modifier << 8 | hidCode);
     }
 
-    bool GetState() const {
-        return m_state;
+    static constexpr Key LayerTap(const char* keyText,
+                                  uint8_t layer,
+                                  uint8_t hidCode) {
+        return Key(keyText, KeyType::LayerTap, layer << 8 | hidCode);
     }
 
-    void SetState(bool state) {
-        m_state = state;
+    constexpr const char* GetText() const {
+        return m_keyText;
     }
 
-    void DoFnFunction(bool state) const {
-        if (m_fnFunction) {
-            m_fnFunction(state);
+    constexpr KeyType GetType() const {
+        return m_type;
+    }
+
+    // HID usage of Keyboard and Consumer keys, index of Macro keys
+    constexpr uint16_t GetCode() const {
+        return m_code;
+    }
+
+    constexpr uint8_t GetModifier() const {
+        switch (m_type) {
+            case KeyType::Modifier:
+                return m_code;
+            case KeyType::ModTap:
+                return m_code >> 8;
+            default:
+                return 0;
         }
     }
 
+    // HID usage sent when a dual-function key is tapped
+    constexpr uint8_t GetTapCode() const {
+        return IsTapHoldKey() ? m_code & 0xFF : 0;
+    }
+
+    constexpr Action GetAction() const {
+        return m_type == KeyType::Action ? static_cast<Action>(m_code)
+                                         : Action::None;
+    }
+
+    constexpr uint8_t GetLayer() const {
+        return m_type == KeyType::LayerTap ? m_code >> 8 : m_code;
+    }
+
+    constexpr bool IsLayerKey() const {
+        return m_type >= KeyType::LayerMomentary &&
+               m_type <= KeyType::LayerDefault;
+    }
+
+    constexpr bool IsTapHoldKey() const {
+        return m_type == KeyType::ModTap || m_type == KeyType::LayerTap;
+    }
+
   private:
+    constexpr Key(const char* keyText, KeyType type, uint16_t code)
+        : m_keyText(keyText),
+          m_type(type),
+          m_code(code) {}
+
     const char* m_keyText;
-    const uint8_t m_modifier;
-    const uint8_t m_hidCode;
-    const uint8_t m_fnKeyCode;
-    const uint16_t m_fnConsumerCode;
-    const FnFunction m_fnFunction;
-    bool m_state;
+    KeyType m_type;
+    uint16_t m_code;
 };
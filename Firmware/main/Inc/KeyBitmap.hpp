@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+
+// Packed set of matrix positions. Every column takes one byte, bit N of that
+// byte being row N, so a whole column can be read or written at once and the
+// full matrix fits in a handful of words.
+class KeyBitmap {
+  public:
+    static constexpr uint8_t MAX_COLUMNS = 16;
+    static constexpr uint8_t MAX_ROWS    = 8;
+    static constexpr uint8_t SIZE        = MAX_COLUMNS * MAX_ROWS;
+    static constexpr uint8_t WORDS_NUM   = SIZE / 32;
+
+    constexpr KeyBitmap() = default;
+
+    constexpr KeyBitmap(std::initializer_list<uint8_t> indexes) {
+        for (uint8_t index : indexes) {
+            Set(index);
+        }
+    }
+
+    static constexpr uint8_t Index(uint8_t column, uint8_t row) {
+        return column * MAX_ROWS + row;
+    }
+
+    static constexpr uint8_t Column(uint8_t index) {
+        return index / MAX_ROWS;
+    }
+
+    static constexpr uint8_t Row(uint8_t index) {
+        return index % MAX_ROWS;
+    }
+
+    constexpr bool Test(uint8_t index) const {
+        return m_words[index / 32] & (1u << (index % 32));
+    }
+
+    constexpr void Set(uint8_t index, bool state = true) {
+        if (state) {
+            m_words[index / 32] |= 1u << (index % 32);
+        } else {
+            m_words[index / 32] &= ~(1u << (index % 32));
+        }
+    }
+
+    constexpr uint8_t GetColumn(uint8_t column) const {
+        return m_words[column / 4] >> ((column % 4) * 8);
+    }
+
+    constexpr void SetColumn(uint8_t column, uint8_t rows) {
+        const uint8_t shift = (column % 4) * 8;
+        m_words[column / 4] =
+            (m_words[column / 4] & ~(0xFFu << shift)) | (rows << shift);
+    }
+
+    constexpr bool Any() const {
+        uint32_t any = 0;
+        for (uint32_t word : m_words) {
+            any |= word;
+        }
+        return any;
+    }
+
+    // Calls function(index) for every position set, in index order
+    template <typename Function>
+    constexpr void ForEach(Function function) const {
+        for (uint8_t i = 0; i < WORDS_NUM; ++i) {
+            uint32_t word = m_words[i];
+            while (word) {
+                function(static_cast<uint8_t>(i * 32 + __builtin_ctz(word)));
+                word &= word - 1;
+            }
+        }
+    }
+
+    constexpr KeyBitmap operator^(const KeyBitmap& other) const {
+        KeyBitmap result;
+        for (uint8_t i = 0; i < WORDS_NUM; ++i) {
+            result.m_words[i] = m_words[i] ^ other.m_words[i];
+        }
+        return result;
+    }
+
+    constexpr KeyBitmap operator&(const KeyBitmap& other) const {
+        KeyBitmap result;
+        for (uint8_t i = 0; i < WORDS_NUM; ++i) {
+            result.m_words[i] = m_words[i] & other.m_words[i];
+        }
+        return result;
+    }
+
+    constexpr KeyBitmap operator|(const KeyBitmap& other) const {
+        KeyBitmap result;
+        for (uint8_t i = 0; i < WORDS_NUM; ++i) {
+            result.m_words[i] = m_words[i] | other.m_words[i];
+        }
+        return result;
+    }
+
+    constexpr KeyBitmap operator~() const {
+        KeyBitmap result;
+        for (uint8_t i = 0; i < WORDS_NUM; ++i) {
+            result.m_words[i] = ~m_words[i];
+        }
+        return result;
+    }
+
+    constexpr KeyBitmap& operator^=(const KeyBitmap& other) {
+        return *this = *this ^ other;
+    }
+
+    constexpr KeyBitmap& operator&=(const KeyBitmap& other) {
+        return *this = *this & other;
+    }
+
+    constexpr KeyBitmap& operator|=(const KeyBitmap& other) {
+        return *this = *this | other;
+    }
+
+    constexpr bool operator==(const KeyBitmap& other) const {
+        return m_words == other.m_words;
+    }
+
+  private:
+    std::array<uint32_t, WORDS_NUM> m_words = {};
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+struct KeyEvent {
+    // Time of the scan that saw the change, in microseconds
+    uint32_t timestamp;
+    // Position in the matrix, as a KeyBitmap index, or index in
+    // layout::combos for a combo. 16 bits fit in the padding after the
+    // timestamp, so combo tables can have more than 256 entries for free.
+    uint16_t key;
+    bool isPressed;
+    bool isCombo = false;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+#include "KeyEvent.hpp"
+#include "UsbHid.hpp"
+
+// Everything between the debounced key events and the HID state sent to the
+// host: combos, tap-hold decisions, the keymap and macros. Only depends on
+// the events and the time given to it, the transport is the report sink, so
+// it can be driven by the USB task or by any other event source.
+namespace key_pipeline {
+
+// Receives the keyboard state every time it must reach the host on its own,
+// returns whether it differs from the previous one
+using ReportSink = bool (*)(const usb_hid::KbHidReport& report);
+
+void Init(ReportSink sink);
+
+// Events must be given in order
+void Process(const KeyEvent& event);
+
+// Expires the combo and tapping terms at nowUs and hands the resulting state
+// to the sink
+void Update(uint32_t nowUs);
+
+// Microseconds until Update() must be called again, UINT32_MAX if nothing
+// waits on time
+uint32_t GetTimeToDeadline(uint32_t nowUs);
+
+// Hands the current state to the sink again, e.g. once it has dropped what
+// it was given because the report format changed
+void Repost();
+
+// Plays the next step of a macro, see macros::Step()
+void StepMacro(uint32_t nowUs);
+
+} // namespace key_pipeline
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "KeyEvent.hpp"
+#include "UsbHid.hpp"
+
+namespace keymap {
+
+// Whether the key is mapped to a dual-function key on the active layers
+bool IsTapHoldKey(uint8_t key);
+
+// Updates the report with what the key of the event is mapped to on the
+// active layers. A release undoes exactly what the press did, even if the
+// layers changed in between. isHold selects the behavior of dual-function
+// keys, as decided by tap_hold::TapHold.
+void ProcessEvent(const KeyEvent& event,
+                  bool isHold,
+                  usb_hid::KbHidReport& report);
+
+} // namespace keymap
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+
+#include <class/hid/hid_device.h>
+
+// HID LampArray, from the Lighting And Illumination usage page. Lets the host
+// query where the LEDs are and set their colours.
+namespace lamp_array {
+
+// Report IDs, after the keyboard and consumer ones
+static constexpr uint8_t ATTRIBUTES_REPORT_ID          = 4;
+static constexpr uint8_t ATTRIBUTES_REQUEST_REPORT_ID  = 5;
+static constexpr uint8_t ATTRIBUTES_RESPONSE_REPORT_ID = 6;
+static constexpr uint8_t MULTI_UPDATE_REPORT_ID        = 7;
+static constexpr uint8_t RANGE_UPDATE_REPORT_ID        = 8;
+static constexpr uint8_t CONTROL_REPORT_ID             = 9;
+
+// Lamps set by one multi update report
+static constexpr uint8_t MULTI_UPDATE_LAMPS = 8;
+
+// Fills a feature report requested by the host. Returns its size, 0 if the
+// report ID does not belong to the LampArray.
+uint16_t GetReport(uint8_t reportId, uint8_t* buffer, uint16_t size);
+
+// Handles a feature report sent by the host. Returns false if the report ID
+// does not belong to the LampArray or the report is malformed.
+bool SetReport(uint8_t reportId, const uint8_t* buffer, uint16_t size);
+
+} // namespace lamp_array
+
+// clang-format off
+#define LAMP_ARRAY_USAGE_PAGE 0x59
+
+#define LAMP_ARRAY_COLOR_USAGES                                               \
+    HID_USAGE(0x51), HID_USAGE(0x52), HID_USAGE(0x53), HID_USAGE(0x54)
+
+// Report descriptor of the LampArray collection, laid out as in the HID Usage
+// Tables. Must match the report structures in LampArray.cpp.
+#define TUD_HID_REPORT_DESC_LAMP_ARRAY()                                      \
+    HID_USAGE_PAGE(LAMP_ARRAY_USAGE_PAGE),                                    \
+    HID_USAGE(0x01), /* LampArray */                                          \
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),                               \
+      HID_REPORT_ID(lamp_array::ATTRIBUTES_REPORT_ID)                         \
+      HID_USAGE(0x02), /* LampArrayAttributesReport */                        \
+      HID_COLLECTION(HID_COLLECTION_LOGICAL),                                 \
+        HID_USAGE(0x03), /* LampCount */                                      \
+        HID_LOGICAL_MIN(0),                                                   \
+        HID_LOGICAL_MAX_N(0xFFFF, 3),                                         \
+        HID_REPORT_SIZE(16),                                                  \
+        HID_REPORT_COUNT(1),                                                  \
+        HID_FEATURE(HID_CONSTANT | HID_VARIABLE | HID_ABSOLUTE),              \
+        HID_USAGE(0x04), /* BoundingBoxWidthInMicrometers */                  \
+        HID_USAGE(0x05), /* BoundingBoxHeightInMicrometers */                 \
+        HID_USAGE(0x06), /* BoundingBoxDepthInMicrometers */                  \
+        HID_USAGE(0x07), /* LampArrayKind */                                  \
+        HID_USAGE(0x08), /* MinUpdateIntervalInMicroseconds */                \
+        HID_LOGICAL_MAX_N(0x7FFFFFFF, 3),                                     \
+        HID_REPORT_SIZE(32),                                                  \
+        HID_REPORT_COUNT(5),                                                  \
+        HID_FEATURE(HID_CONSTANT | HID_VARIABLE | HID_ABSOLUTE),              \
+      HID_COLLECTION_END,                                                     \
+                                                                              \
+      HID_REPORT_ID(lamp_array::ATTRIBUTES_REQUEST_REPORT_ID)                 \
+      HID_USAGE(0x20), /* LampAttributesRequestReport */                      \
+      HID_COLLECTION(HID_COLLECTION_LOGICAL),                                 \
+        HID_USAGE(0x21), /* LampId */                                         \
+        HID_LOGICAL_MAX_N(0xFFFF, 3),                                         \
+        HID_REPORT_SIZE(16),                                                  \
+        HID_REPORT_COUNT(1),                                                  \
+        HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),                  \
+      HID_COLLECTION_END,                                                     \
+                                                                              \
+      HID_REPORT_ID(lamp_array::ATTRIBUTES_RESPONSE_REPORT_ID)                \
+      HID_USAGE(0x22), /* LampAttributesResponseReport */                     \
+      HID_COLLECTION(HID_COLLECTION_LOGICAL),                                 \
+        HID_USAGE(0x21), /* LampId */                                         \
+        HID_LOGICAL_MAX_N(0xFFFF, 3),                                         \
+        HID_REPORT_SIZE(16),                                                  \
+        HID_REPORT_COUNT(1),                                                  \
+        HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),                  \
+        HID_USAGE(0x23), /* PositionXInMicrometers */                         \
+        HID_USAGE(0x24), /* PositionYInMicrometers */                         \
+        HID_USAGE(0x25), /* PositionZInMicrometers */                         \
+        HID_USAGE(0x27), /* UpdateLatencyInMicroseconds */                    \
+        HID_USAGE(0x26), /* LampPurposes */                                   \
+        HID_LOGICAL_MAX_N(0x7FFFFFFF, 3),                                     \
+        HID_REPORT_SIZE(32),                                                  \
+        HID_REPORT_COUNT(5),                                                  \
+        HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),                  \
+        HID_USAGE(0x28), /* RedLevelCount */                                  \
+        HID_USAGE(0x29), /* GreenLevelCount */                                \
+        HID_USAGE(0x2A), /* BlueLevelCount */                                 \
+        HID_USAGE(0x2B), /* IntensityLevelCount */                            \
+        HID_USAGE(0x2C), /* IsProgrammable */                                 \
+        HID_USAGE(0x2D), /* InputBinding */                                   \
+        HID_LOGICAL_MAX_N(0xFF, 2),                                           \
+        HID_REPORT_SIZE(8),                                                   \
+        HID_REPORT_COUNT(6),                                                  \
+        HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),                  \
+      HID_COLLECTION_END,                                                     \
+                                                                              \
+      HID_REPORT_ID(lamp_array::MULTI_UPDATE_REPORT_ID)                       \
+      HID_USAGE(0x50), /* LampMultiUpdateReport */                            \
+      HID_COLLECTION(HID_COLLECTION_LOGICAL),                                 \
+        HID_USAGE(0x03), /* LampCount */                                      \
+        HID_USAGE(0x55), /* LampUpdateFlags */                                \
+        HID_LOGICAL_MAX(lamp_array::MULTI_UPDATE_LAMPS),                      \
+        HID_REPORT_SIZE(8),                                                   \
+        HID_REPORT_COUNT(2),                                                  \
+        HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),                  \
+        HID_USAGE(0x21), /* LampId, repeated for every lamp */                \
+        HID_LOGICAL_MAX_N(0xFFFF, 3),                                         \
+        HID_REPORT_SIZE(16),                                                  \
+        HID_REPORT_COUNT(lamp_array::MULTI_UPDATE_LAMPS),                     \
+        HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),                  \
+        LAMP_ARRAY_COLOR_USAGES, LAMP_ARRAY_COLOR_USAGES,                     \
+        LAMP_ARRAY_COLOR_USAGES, LAMP_ARRAY_COLOR_USAGES,                     \
+        LAMP_ARRAY_COLOR_USAGES, LAMP_ARRAY_COLOR_USAGES,                     \
+        LAMP_ARRAY_COLOR_USAGES, LAMP_ARRAY_COLOR_USAGES,                     \
+        HID_LOGICAL_MAX_N(0xFF, 2),                                           \
+        HID_REPORT_SIZE(8),                                                   \
+        HID_REPORT_COUNT(4 * lamp_array::MULTI_UPDATE_LAMPS),                 \
+        HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),                  \
+      HID_COLLECTION_END,                                                     \
+                                                                              \
+      HID_REPORT_ID(lamp_array::RANGE_UPDATE_REPORT_ID)                       \
+      HID_USAGE(0x60), /* LampRangeUpdateReport */                            \
+      HID_COLLECTION(HID_COLLECTION_LOGICAL),                                 \
+        HID_USAGE(0x55), /* LampUpdateFlags */                                \
+        HID_LOGICAL_MAX(8),                                                   \
+        HID_REPORT_SIZE(8),                                                   \
+        HID_REPORT_COUNT(1),                                                  \
+        HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),                  \
+        HID_USAGE(0x61), /* LampIdStart */                                    \
+        HID_USAGE(0x62), /* LampIdEnd */                                      \
+        HID_LOGICAL_MAX_N(0xFFFF, 3),                                         \
+        HID_REPORT_SIZE(16),                                                  \
+        HID_REPORT_COUNT(2),                                                  \
+        HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),                  \
+        LAMP_ARRAY_COLOR_USAGES,                                              \
+        HID_LOGICAL_MAX_N(0xFF, 2),                                           \
+        HID_REPORT_SIZE(8),                                                   \
+        HID_REPORT_COUNT(4),                                                  \
+        HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),                  \
+      HID_COLLECTION_END,                                                     \
+                                                                              \
+      HID_REPORT_ID(lamp_array::CONTROL_REPORT_ID)                            \
+      HID_USAGE(0x70), /* LampArrayControlReport */                           \
+      HID_COLLECTION(HID_COLLECTION_LOGICAL),                                 \
+        HID_USAGE(0x71), /* AutonomousMode */                                 \
+        HID_LOGICAL_MAX(1),                                                   \
+        HID_REPORT_SIZE(8),                                                   \
+        HID_REPORT_COUNT(1),                                                  \
+        HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),                  \
+      HID_COLLECTION_END,                                                     \
+    HID_COLLECTION_END
+// clang-format on
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+#include <sdkconfig.h>
+
+namespace latency {
+
+#ifdef CONFIG_KEYBOARD_LATENCY_STATS
+static constexpr bool IS_ENABLED = true;
+#else
+static constexpr bool IS_ENABLED = false;
+#endif
+
+// Stages a key change goes through, all times taken with esp_timer so they
+// compare across cores
+enum class Stage : uint8_t {
+    // First scan that sees the raw change until the debouncer commits it
+    Debounce = 0,
+    // Commit until the USB task takes the event from the ring
+    HandOff,
+    // Commit until the report holding the change is given to tud_hid_report,
+    // including combo and tap-hold decisions
+    Report,
+    // tud_hid_report until tud_hid_report_complete_cb, i.e. the host polled
+    Transfer,
+    // Commit until tud_hid_report_complete_cb
+    Total,
+};
+static constexpr uint8_t STAGES_NUM = 5;
+
+#ifdef CONFIG_KEYBOARD_LATENCY_STATS
+
+void Record(Stage stage, uint32_t durationUs);
+
+// A report changed by events committed at eventTimestamp has been queued
+void OnReportPosted(uint32_t eventTimestamp);
+// Called right before tud_hid_report, so the transfer can not complete
+// before it is tracked, and after it if it failed
+void OnReportSending();
+void OnReportSendFailed();
+// Called from tud_hid_report_complete_cb
+void OnReportComplete();
+
+// Logs the histograms of every stage
+void Print();
+
+#else
+
+// Compiled out, calls vanish
+
+inline void Record([[maybe_unused]] Stage stage,
+                   [[maybe_unused]] uint32_t durationUs) {}
+inline void OnReportPosted([[maybe_unused]] uint32_t eventTimestamp) {}
+inline void OnReportSending() {}
+inline void OnReportSendFailed() {}
+inline void OnReportComplete() {}
+inline void Print() {}
+
+#endif
+
+} // namespace latency
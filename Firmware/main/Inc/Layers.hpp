@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Key.hpp"
+
+namespace layers {
+
+// Layer whose entry the key uses with the layers active right now, resolved
+// with a single mask lookup whatever the number of layers
+uint8_t Resolve(uint8_t key);
+
+// Applies the press or release of a key of one of the Layer* types, type
+// being how the key behaves, e.g. LayerMomentary for a held LayerTap key
+void ProcessLayerKey(KeyType type, uint8_t layer, bool isPressed);
+
+// Must be called after every other key press has been resolved, ends a
+// one-shot layer
+void OnKeyPressed();
+
+} // namespace layers
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include <driver/gpio.h>
+#include <esp_log.h>
+
+#include "led_strip.h"
+
+#include "Rgb.hpp"
+
+namespace leds {
+
+// A chain of addressable LEDs behind a frame buffer in RAM. Set() only
+// writes the buffer, Refresh() sends all of it in a single RMT transfer and
+// only if it changed since the last one.
+template <uint16_t SIZE>
+class Strip {
+  public:
+    static constexpr uint32_t BITS_PER_LED = 24;
+    // WS2812 and SK6812 take 1.25 us per bit and latch after a reset low
+    // time of at most 280 us
+    static constexpr std::chrono::microseconds TRANSFER_TIME =
+        std::chrono::microseconds((SIZE * BITS_PER_LED * 1250 + 999) / 1000 +
+                                  280);
+
+    // With DMA the RMT channel gets a buffer that holds the whole frame plus
+    // the reset code, so a refresh is one DMA transfer and the CPU is not
+    // interrupted every few pixels to refill the channel memory. The ESP32-S3
+    // has a single DMA capable TX channel.
+    bool Setup(gpio_num_t pin, led_model_t model, bool withDma) {
+        const led_strip_config_t stripConfig = {
+            .strip_gpio_num   = pin,
+            .max_leds         = SIZE,
+            .led_pixel_format = LED_PIXEL_FORMAT_GRB,
+            .led_model        = model,
+            .flags            = {.invert_out = false},
+        };
+        const led_strip_rmt_config_t rmtConfig = {
+            .clk_src           = RMT_CLK_SRC_DEFAULT,
+            .resolution_hz     = 0,
+            .mem_block_symbols = withDma ? SIZE * BITS_PER_LED + 2 : 0,
+            .flags             = {.with_dma = withDma},
+        };
+
+        if (led_strip_new_rmt_device(&stripConfig, &rmtConfig, &m_handle) !=
+            ESP_OK) {
+            ESP_LOGE("LedStrip", "Setup failed on GPIO %d", pin);
+            return false;
+        }
+        led_strip_clear(m_handle);
+        m_frame   = {};
+        m_isDirty = false;
+        return true;
+    }
+
+    void Set(uint16_t index, const Rgb& color) {
+        if (m_frame[index] != color) {
+            m_frame[index] = color;
+            m_isDirty      = true;
+        }
+    }
+
+    void Fill(const Rgb& color) {
+        for (uint16_t i = 0; i < SIZE; i++) {
+            Set(i, color);
+        }
+    }
+
+    const Rgb& Get(uint16_t index) const {
+        return m_frame[index];
+    }
+
+    // Blocks the calling task, not the CPU, until the transfer is done
+    bool Refresh() {
+        if (!m_isDirty) {
+            return true;
+        }
+        for (uint16_t i = 0; i < SIZE; i++) {
+            led_strip_set_pixel(m_handle,
+                                i,
+                                m_frame[i].red,
+                                m_frame[i].green,
+                                m_frame[i].blue);
+        }
+        if (led_strip_refresh(m_handle) != ESP_OK) {
+            return false;
+        }
+        m_isDirty = false;
+        return true;
+    }
+
+  private:
+    led_strip_handle_t m_handle = nullptr;
+    std::array<Rgb, SIZE> m_frame;
+    bool m_isDirty = false;
+};
+
+} // namespace leds
@@ -1,28 +1,65 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 
+#include <sdkconfig.h>
+
+#include "Layout.hpp"
+#include "Rgb.hpp"
+
 namespace leds {
 
-enum class Commands : uint8_t {
-    CapsOnUsb = 0,
-    CapsOnBle,
-    Usb,
+// Animations and lamp updates from the host are drawn at this rate, about
+// 60 fps
+static constexpr std::chrono::milliseconds FRAME_PERIOD(16);
+
+#ifdef CONFIG_KEYBOARD_KEY_LEDS
+// One LED per matrix position, chained column by column
+static constexpr uint16_t KEY_LEDS_NUM =
+    layout::COLUMNS_NUM * layout::ROWS_NUM;
+#else
+static constexpr uint16_t KEY_LEDS_NUM = 0;
+#endif
+
+// LEDs the host can drive through the HID LampArray interface. Lamp 0 is the
+// status LED, the key LEDs follow.
+static constexpr uint16_t LAMPS_NUM = 1 + KEY_LEDS_NUM;
+
+static constexpr uint16_t KeyLamp(uint8_t column, uint8_t row) {
+    return 1 + column * layout::ROWS_NUM + row;
+}
+
+enum class Mode : uint8_t {
+    Usb = 0,
     BluetoothSearching,
     BluetoothConnected,
     NotConnected,
     Error,
-
-    DecreaseBrightness = 20,
-    IncreaseBrightness,
 };
 
-bool SendCommand(Commands);
-Commands GetMode();
+// Requests from other tasks are coalesced: only the latest mode and caps lock
+// state and the sum of the brightness steps are kept. Setting them never
+// blocks nor loses anything, and a burst of them wakes the LED task once.
+void SetMode(Mode);
+// Returns the latest mode set, even if it is not shown yet
+Mode GetMode();
+void SetCapsLock(bool isOn);
+// Turns every LED off and stops animating until resumed
+void SetSuspended(bool isSuspended);
 
 bool SetupTask();
 
 void DecreaseBrightness(bool);
 void IncreaseBrightness(bool);
 
+// While not autonomous the lamps show the colours set by the host instead of
+// the mode. Going back to NotConnected makes them autonomous again.
+void SetAutonomous(bool isAutonomous);
+// Stages the colour of a lamp. Staged colours are shown together, on the
+// next frame after CommitLamps(), so any number of updates between two frames
+// costs a single refresh.
+void SetLamp(uint16_t lamp, const Rgb& color);
+void CommitLamps();
+
 } // namespace leds
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+// Macros are stored as bytecode in flash, each instruction being an opcode
+// followed by its argument. A macro ends with MACRO_END, which has no
+// argument, e.g.
+//
+//   {MACRO_MODIFIERS, KEYBOARD_MODIFIER_LEFTSHIFT, MACRO_TAP, HID_KEY_H,
+//    MACRO_MODIFIERS, 0, MACRO_TAP, HID_KEY_I, MACRO_END}
+//
+// Plain enum so instructions can be written in uint8_t arrays.
+enum MacroOp : uint8_t {
+    // Last byte of the macro
+    MACRO_END = 0,
+    // Keyboard usage to press
+    MACRO_PRESS,
+    // Keyboard usage to release
+    MACRO_RELEASE,
+    // Keyboard usage to press and release in the next report
+    MACRO_TAP,
+    // Milliseconds to wait before the next instruction
+    MACRO_DELAY,
+    // Modifiers held from now on, replacing the previous mask
+    MACRO_MODIFIERS,
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+#include "UsbHid.hpp"
+
+namespace macros {
+
+// Queues one of layout::macros. Macros play one after the other, alongside
+// the keys typed in the meantime.
+void Play(uint8_t macro);
+
+bool IsPlaying();
+
+// Runs the macro up to its next change of the report and returns whether it
+// changed. Must be called once the previous change has been handed to the
+// host, so every step gets its own report and none is merged away.
+bool Step(uint32_t nowUs);
+
+// Microseconds left before a MACRO_DELAY ends, 0 if not waiting
+uint32_t GetDelay(uint32_t nowUs);
+
+// Keys and modifiers held by the macro, to be merged with the typed ones
+const usb_hid::KbHidReport& GetReport();
+
+} // namespace macros
@@ -6,4 +6,8 @@ namespace matrix {
 
 bool SetupTask();
 
+// While the host is suspended, scanning stops as soon as every key has been
+// released instead of after the idle timeout
+void SetSuspended(bool isSuspended);
+
 } // namespace matrix
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "KeyBitmap.hpp"
+
+// Access to the switch matrix hardware, kept apart from the scanning logic so
+// another backend, e.g. a virtual matrix on a host, can be linked instead
+namespace matrix_io {
+
+// Sets the pins up and installs the row interrupts on the calling core
+bool Init();
+
+// Only sets the pins up: rows as pulled down inputs, columns as outputs.
+// Lets the matrix be read before the matrix task runs Init().
+bool SetupPins();
+
+// Drives every column in turn and returns the raw state of every key
+KeyBitmap Read();
+
+// Same as Read() but one gpio_get_level() per key, as the matrix used to be
+// read. Only kept to compare the two when profiling.
+KeyBitmap ReadPerPin();
+
+// Blocks the calling task until some key is pressed
+void WaitForKeyPress();
+
+} // namespace matrix_io
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "Debounce.hpp"
+#include "KeyBitmap.hpp"
+#include "KeyEvent.hpp"
+
+namespace matrix_scan {
+
+// What a scan does with the raw state of the matrix: finds the keys that
+// changed, debounces them and hands on an event for every debounced change.
+// The matrix task only reads the matrix and paces the scans, so the host
+// build runs this same code on a virtual matrix.
+class Scanner {
+  public:
+    // Microseconds since boot, only read when some key changed
+    using Clock = int64_t (*)();
+    // Receives every debounced change, in order
+    using Output = void (*)(const KeyEvent& event);
+
+    Scanner(debounce::Algorithm algorithm,
+            uint8_t debounceTimeMs,
+            Clock clock,
+            Output output);
+
+    // Feeds the raw state read by one scan. Returns whether the matrix must
+    // keep being scanned, either because some key is pressed or because a
+    // change is still being debounced.
+    bool Update(const KeyBitmap& raw);
+
+  private:
+    debounce::Debouncer m_debouncer;
+    const Clock m_clock;
+    const Output m_output;
+
+    KeyBitmap m_lastRaw;
+    // Time of the scan that last saw each key change, for latency statistics
+    std::array<uint32_t, KeyBitmap::SIZE> m_rawChangeTimes = {};
+};
+
+} // namespace matrix_scan
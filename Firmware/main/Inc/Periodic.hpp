@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include <driver/gptimer.h>
+
+#include "RtosUtils.hpp"
+
+namespace rtos {
+
+// Wakes up a task at a fixed period from a hardware timer interrupt. The
+// period does not drift with the work done between wake ups and can be much
+// shorter than a tick.
+class Periodic {
+  public:
+    struct Stats {
+        uint32_t periods;
+        // Periods missed because the work took longer than the period
+        uint32_t overruns;
+        // Deviation of the time between two wake ups from the period
+        uint32_t maxJitterUs;
+        uint64_t totalJitterUs;
+    };
+
+    // The waiting task is woken up through notifyIndex, which it must not
+    // use for anything else
+    Periodic(std::chrono::microseconds period, UBaseType_t notifyIndex)
+        : m_period(period),
+          m_notify(notifyIndex) {}
+
+    // Must be called from the task that waits, the interrupt is allocated on
+    // its core
+    bool Setup();
+
+    // The first period starts now. The timer is only enabled while started,
+    // since an enabled timer holds a power management lock on its clock.
+    bool Start();
+    bool Stop();
+
+    // Blocks until the next period starts
+    void Wait();
+
+    const Stats& GetStats() const {
+        return m_stats;
+    }
+
+    void ResetStats() {
+        m_stats = {};
+    }
+
+  private:
+    static bool OnAlarm(gptimer_handle_t timer,
+                        const gptimer_alarm_event_data_t* eventData,
+                        void* arg);
+
+    const std::chrono::microseconds m_period;
+    gptimer_handle_t m_timer = nullptr;
+    Notify m_notify;
+
+    bool m_isRunning = false;
+    // Time of the last wake up, only valid after the first one since Start()
+    bool m_isLastWakeValid = false;
+    uint32_t m_lastWake    = 0;
+    Stats m_stats          = {};
+};
+
+} // namespace rtos
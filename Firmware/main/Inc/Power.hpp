@@ -0,0 +1,46 @@
+#pragma once
+
+#include <sdkconfig.h>
+
+// Dynamic frequency scaling and automatic light sleep through esp_pm. While
+// no lock is held the CPU runs at MIN_CPU_FREQ_MHZ, and when every task is
+// blocked the idle task skips ticks and puts the chip in light sleep. The USB
+// lock keeps it out of light sleep unless the host has suspended the bus, so
+// in practice the chip only sleeps while the host does and no key is held.
+// Each lock must only be set from a single task.
+namespace power {
+
+#ifdef CONFIG_PM_ENABLE
+
+// Must be called before the tasks start
+bool Init();
+
+// The matrix is being scanned, keeps the CPU at its maximum frequency
+void SetScanning(bool isScanning);
+// Reports are being handed to the host, keeps the CPU at its maximum
+// frequency
+void SetTransferring(bool isTransferring);
+// The USB peripheral stops in light sleep, so the chip must stay awake while
+// the bus is active. Held from Init().
+void SetUsbActive(bool isActive);
+
+// Logs the locks held, and with CONFIG_PM_PROFILING the time spent in each
+// mode and how many times light sleep was entered, to count the wake ups
+// during a suspend
+void PrintStats();
+
+#else
+
+// Compiled out, the CPU always runs at its default frequency
+
+inline bool Init() {
+    return true;
+}
+inline void SetScanning([[maybe_unused]] bool isScanning) {}
+inline void SetTransferring([[maybe_unused]] bool isTransferring) {}
+inline void SetUsbActive([[maybe_unused]] bool isActive) {}
+inline void PrintStats() {}
+
+#endif
+
+} // namespace power
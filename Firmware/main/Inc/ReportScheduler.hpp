@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "UsbHid.hpp"
+
+namespace usb_hid {
+
+static constexpr uint8_t KEYBOARD_REPORT_ID = 1;
+static constexpr uint8_t CONSUMER_REPORT_ID = 3;
+
+// The boot protocol report only has room for six keys, more than that is
+// reported as a rollover error
+static constexpr uint8_t BOOT_REPORT_MAX_KEYS = 6;
+static constexpr uint8_t BOOT_REPORT_SIZE     = 2 + BOOT_REPORT_MAX_KEYS;
+static constexpr uint8_t ROLLOVER_ERROR       = 0x01;
+
+struct [[gnu::packed]] NkroReport {
+    uint8_t modifiers;
+    std::array<uint8_t, NKRO_USAGES_NUM / 8> keys;
+};
+
+// Pending reports are sent in this order whenever the endpoint is free
+enum class Slot : uint8_t {
+    Keyboard = 0,
+    Consumer,
+};
+
+// Packs the keyboard state into the HID reports of the protocol in use and
+// keeps the latest state of each report ID until the endpoint takes it. Each
+// report ID has its own slot so reports of different kinds never replace or
+// delay each other.
+//
+// The endpoint is only reached through the functions given, so the host
+// build runs the same packing and scheduling against a fake one.
+class ReportScheduler {
+  public:
+    // Whether the endpoint can take a report right now
+    using IsReady = bool (*)();
+    // Hands a report to the endpoint, returns whether it was taken
+    using Send = bool (*)(uint8_t reportId, const uint8_t* data, uint8_t size);
+    // Blocks until the endpoint can take a report, returns false if the host
+    // has gone away
+    using WaitReady = bool (*)();
+
+    static constexpr uint8_t SLOTS_NUM = 2;
+
+    ReportScheduler(IsReady isReady, Send send, WaitReady waitReady);
+
+    // Splits the keyboard state into the reports of the protocol in use.
+    // Returns whether any of them changed.
+    bool Post(const KbHidReport& report, bool isBootProtocol);
+
+    // Forgets the pending reports and what the host was last sent, so the
+    // next post of every report ID goes out whatever it holds
+    void Reset();
+
+    bool IsPending(Slot slot) const {
+        return m_slots[static_cast<uint8_t>(slot)].isPending;
+    }
+
+    bool IsAnyPending() const;
+
+    // Sends the highest priority pending report if the endpoint is free.
+    // Returns whether a report was sent.
+    bool Service();
+
+    // Sends every pending report, waiting for the endpoint between them.
+    // Gives up if the host goes away, the pending reports are then
+    // overwritten, or if the endpoint refuses a report, the pending reports
+    // are then dropped. Returns whether everything was sent.
+    bool Flush();
+
+  private:
+    static constexpr uint8_t SLOT_MAX_SIZE = sizeof(NkroReport);
+
+    struct ReportSlot {
+        uint8_t reportId;
+        uint8_t size;
+        bool isPending;
+        std::array<uint8_t, SLOT_MAX_SIZE> pending;
+        std::array<uint8_t, SLOT_MAX_SIZE> sent;
+    };
+
+    bool PostReport(Slot slotId,
+                    uint8_t reportId,
+                    const void* data,
+                    uint8_t size);
+
+    const IsReady m_isReady;
+    const Send m_send;
+    const WaitReady m_waitReady;
+
+    std::array<ReportSlot, SLOTS_NUM> m_slots = {};
+};
+
+} // namespace usb_hid
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+namespace leds {
+
+struct Rgb {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+
+    bool operator==(const Rgb&) const = default;
+};
+
+} // namespace leds
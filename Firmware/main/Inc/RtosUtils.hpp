@@ -5,20 +5,32 @@
 #include <freertos/queue.h>
 #include <freertos/task.h>
 #include <freertos/timers.h>
+
+#include <array>
+#include <chrono>
 #include <functional>
 #include <optional>
 
 namespace rtos {
 
-void Delay(const TickType_t ticksToDelay);
+// Blocks for at least the given time, rounded up to whole ticks
+void Delay(std::chrono::milliseconds time);
+
+TickType_t ToTicks(std::chrono::milliseconds time);
 
-template <typename T>
+// Every object below keeps its kernel storage inside, so declared at file
+// scope they are all allocated at link time and never touch the heap.
+
+template <typename T, uint32_t SIZE>
 class Queue {
   public:
-    Queue(uint32_t size) : m_size(size) {}
-
     bool Setup() {
-        m_handle = xQueueCreate(m_size, sizeof(T));
+        if (!m_handle) {
+            m_handle = xQueueCreateStatic(SIZE,
+                                          sizeof(T),
+                                          m_storage.data(),
+                                          &m_queue);
+        }
         return (m_handle != nullptr);
     }
 
@@ -42,18 +54,71 @@ class Queue {
     }
 
   private:
-    QueueHandle_t m_handle;
-    uint32_t m_size;
+    QueueHandle_t m_handle = nullptr;
+    StaticQueue_t m_queue;
+    std::array<uint8_t, SIZE * sizeof(T)> m_storage;
+};
+
+// Wakes up one task, from another task or from an interrupt, through its
+// direct to task notification. Nothing is copied and no kernel object is
+// created, so it is lighter and wakes up faster than a queue, but only one
+// task may wait on it.
+//
+// Each one uses its own index in the notification array of the waiting task,
+// otherwise a give meant for one wait ends another. Index 0 is used by the
+// kernel, the indices are assigned in TaskPlan.hpp.
+class Notify {
+  public:
+    explicit Notify(UBaseType_t index) : m_index(index) {}
+
+    // Binds to the calling task, which is the one that waits
+    void Bind() {
+        m_task = xTaskGetCurrentTaskHandle();
+    }
+
+    // Gives before the waiting task is bound are lost
+    void Give() {
+        if (m_task) {
+            xTaskNotifyGiveIndexed(m_task, m_index);
+        }
+    }
+
+    // Returns whether a higher priority task was woken up, in which case the
+    // interrupt must yield
+    bool GiveFromIsr() {
+        BaseType_t higherPriorityTaskWoken = pdFALSE;
+        if (m_task) {
+            vTaskNotifyGiveIndexedFromISR(m_task,
+                                          m_index,
+                                          &higherPriorityTaskWoken);
+        }
+        return higherPriorityTaskWoken == pdTRUE;
+    }
+
+    // Returns the number of gives since the last wait, 0 on timeout
+    uint32_t Wait(TickType_t timeout = portMAX_DELAY) {
+        return ulTaskNotifyTakeIndexed(m_index, pdTRUE, timeout);
+    }
+
+    // Drops a give that happened before
+    void Clear() {
+        ulTaskNotifyTakeIndexed(m_index, pdTRUE, 0);
+    }
+
+  private:
+    const UBaseType_t m_index;
+    TaskHandle_t m_task = nullptr;
 };
 
 class Timer {
   public:
+    // The period is rounded up to whole ticks
     Timer(const char* name,
-          uint32_t period,
+          std::chrono::milliseconds period,
           bool autoReload,
           void (*callback)())
         : m_name(name),
-          m_period(period),
+          m_period(ToTicks(period)),
           m_autoReload(autoReload),
           m_callback(callback) {}
 
@@ -79,7 +144,12 @@ class Timer {
     }
 
     bool Setup() {
-        m_handle = xTimerCreate(m_name, m_period, m_autoReload, this, Callback);
+        m_handle = xTimerCreateStatic(m_name,
+                                      m_period,
+                                      m_autoReload,
+                                      this,
+                                      Callback,
+                                      &m_timer);
         if (!m_handle) {
             ESP_LOGE(m_name, "Setup failed");
             return false;
@@ -93,8 +163,9 @@ class Timer {
 
   private:
     TimerHandle_t m_handle;
+    StaticTimer_t m_timer;
     const char* m_name;
-    uint32_t m_period;
+    TickType_t m_period;
     bool m_autoReload;
     void (*m_callback)();
 
@@ -104,29 +175,32 @@ class Timer {
     }
 };
 
+// STACK_SIZE is in bytes
+template <uint32_t STACK_SIZE>
 class Task {
   public:
+    // core is the core the task is pinned to, or tskNO_AFFINITY
     Task(const char* name,
-         uint32_t size,
          uint32_t priority,
          bool (*initFunction)(),
-         void (*handlerFunction)())
+         void (*handlerFunction)(),
+         BaseType_t core = tskNO_AFFINITY)
         : m_name(name),
-          m_size(size),
           m_priority(priority),
+          m_core(core),
           m_initFunction(initFunction),
           m_handlerFunction(handlerFunction) {}
 
     bool Setup() {
-        if (xTaskCreate(TaskFunction,
-                        m_name,
-                        m_size,
-                        this,
-                        m_priority,
-                        &m_handle) != pdPASS) {
-            return false;
-        }
-        return true;
+        m_handle = xTaskCreateStaticPinnedToCore(TaskFunction,
+                                                 m_name,
+                                                 STACK_SIZE,
+                                                 this,
+                                                 m_priority,
+                                                 m_stack.data(),
+                                                 &m_task,
+                                                 m_core);
+        return m_handle != nullptr;
     }
 
     TaskHandle_t* GetHandle() {
@@ -135,9 +209,11 @@ class Task {
 
   private:
     TaskHandle_t m_handle;
+    StaticTask_t m_task;
+    std::array<StackType_t, STACK_SIZE / sizeof(StackType_t)> m_stack;
     const char* m_name;
-    uint32_t m_size;
     uint32_t m_priority;
+    BaseType_t m_core;
     bool (*m_initFunction)();
     void (*m_handlerFunction)();
 
@@ -145,7 +221,7 @@ class Task {
         Task* obj = static_cast<Task*>(arg);
         while (obj->m_initFunction() == false) {
             ESP_LOGE(obj->m_name, "Init failed");
-            rtos::Delay(100);
+            rtos::Delay(std::chrono::milliseconds(100));
         }
         ESP_LOGI(obj->m_name, "Init Successful");
         while (1) {
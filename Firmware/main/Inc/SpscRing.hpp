@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+
+// Lock-free ring buffer for exactly one producer and one consumer, which may
+// run on different cores. Nothing is copied through the kernel and neither
+// side ever blocks.
+template <typename T, uint32_t SIZE>
+class SpscRing {
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+
+  public:
+    bool Push(const T& item) {
+        const uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == SIZE) {
+            return false;
+        }
+        m_items[head % SIZE] = item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::optional<T> Pop() {
+        const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return std::nullopt;
+        }
+        const T item = m_items[tail % SIZE];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return item;
+    }
+
+  private:
+    std::array<T, SIZE> m_items;
+    std::atomic<uint32_t> m_head = 0;
+    std::atomic<uint32_t> m_tail = 0;
+};
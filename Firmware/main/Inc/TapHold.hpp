@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "KeyBitmap.hpp"
+#include "KeyEvent.hpp"
+
+namespace tap_hold {
+
+enum class Mode : uint8_t {
+    // Hold only once the key has been down for the tapping term
+    TappingTerm = 0,
+    // Also hold if another key is pressed and released within the term
+    PermissiveHold,
+    // Also hold as soon as another key is pressed within the term
+    HoldOnOtherKeyPress,
+};
+
+// Decides whether dual-function keys are tapped or held. Events that arrive
+// while a decision is pending are buffered and replayed once it is taken, so
+// the rest of the pipeline sees them in order and after the decision.
+//
+// Decisions only depend on the event timestamps, and Update() must be called
+// when the deadline returned by GetDeadline() is reached. Independent of
+// ESP-IDF so scripted timelines can be replayed on the host.
+class TapHold {
+  public:
+    // Whether the key, as currently mapped, is a dual-function key
+    using IsTapHoldKey = bool (*)(uint8_t key);
+    // Receives every event once decided. isHold only matters for
+    // dual-function keys, and is the same for their press and release.
+    using Output = void (*)(const KeyEvent& event, bool isHold);
+
+    static constexpr uint8_t BUFFER_SIZE = 16;
+
+    TapHold(Mode mode,
+            uint16_t tappingTermMs,
+            IsTapHoldKey isTapHoldKey,
+            Output output);
+
+    void Process(const KeyEvent& event);
+
+    // Resolves a pending key as held if its term has expired at nowUs
+    void Update(uint32_t nowUs);
+
+    bool IsPending() const {
+        return m_isPending;
+    }
+
+    // Time at which Update() must be called, only valid while pending
+    uint32_t GetDeadline() const {
+        return m_pending.timestamp + m_tappingTermUs;
+    }
+
+  private:
+    void Resolve(bool isHold);
+    bool IsExpired(uint32_t nowUs) const;
+
+    const Mode m_mode;
+    const uint32_t m_tappingTermUs;
+    const IsTapHoldKey m_isTapHoldKey;
+    const Output m_output;
+
+    bool m_isPending = false;
+    KeyEvent m_pending = {};
+    std::array<KeyEvent, BUFFER_SIZE> m_buffer = {};
+    uint8_t m_bufferSize = 0;
+    // Keys pressed after the pending one, to detect a permissive hold
+    KeyBitmap m_pressedWhilePending;
+    // Dual-function keys currently held down that were resolved as held
+    KeyBitmap m_holds;
+};
+
+} // namespace tap_hold
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <sdkconfig.h>
+
+// Cores and priorities of the application tasks, kept in one place so the
+// whole plan can be checked at once.
+//
+// Core 1 only runs the matrix scan and its row interrupts, so neither USB
+// traffic nor a busy LED animation can delay a scan. Core 0 runs everything
+// that talks to the host, TinyUSB (CONFIG_TINYUSB_TASK_AFFINITY_CPU0 and
+// CONFIG_TINYUSB_TASK_PRIORITY) and the USB HID task with their interrupts,
+// the LEDs at the lowest priority, and the IDF system tasks that are pinned
+// there by default. The deferred log drain task runs below everything else.
+// Interrupts are allocated on the core of the task that
+// installs them, so each task installs its own.
+namespace task_plan {
+
+struct Placement {
+    BaseType_t core;
+    UBaseType_t priority;
+};
+
+static constexpr BaseType_t HOST_CORE = 0;
+static constexpr BaseType_t SCAN_CORE = 1;
+
+static constexpr Placement MATRIX  = {SCAN_CORE, 20};
+static constexpr Placement USB_HID = {HOST_CORE, 20};
+static constexpr Placement LEDS    = {HOST_CORE, 2};
+static constexpr Placement LOG     = {HOST_CORE, 1};
+
+// Notification indices of the task waits. Indices belong to a task, so the
+// waits of different tasks may share one, but each wait of a task needs its
+// own. Index 0 is left to the kernel, stream and message buffers use it.
+static constexpr UBaseType_t MATRIX_SCAN_NOTIFY      = 1;
+static constexpr UBaseType_t MATRIX_KEY_PRESS_NOTIFY = 2;
+static_assert(MATRIX_KEY_PRESS_NOTIFY < configTASK_NOTIFICATION_ARRAY_ENTRIES);
+
+static constexpr UBaseType_t USB_HID_WAKE_UP_NOTIFY = 1;
+static_assert(USB_HID_WAKE_UP_NOTIFY < configTASK_NOTIFICATION_ARRAY_ENTRIES);
+
+static constexpr UBaseType_t LEDS_FRAME_NOTIFY = 1;
+static_assert(LEDS_FRAME_NOTIFY < configTASK_NOTIFICATION_ARRAY_ENTRIES);
+
+static constexpr UBaseType_t LOG_DRAIN_NOTIFY = 1;
+static_assert(LOG_DRAIN_NOTIFY < configTASK_NOTIFICATION_ARRAY_ENTRIES);
+
+// TinyUSB preempts the USB HID task, so transfer completions are handled as
+// soon as they happen
+static_assert(CONFIG_TINYUSB_TASK_PRIORITY > USB_HID.priority);
+#ifndef CONFIG_TINYUSB_TASK_AFFINITY_CPU0
+#error "TinyUSB must run on HOST_CORE"
+#endif
+
+} // namespace task_plan
@@ -1,17 +1,43 @@
 #pragma once
 
-#include "Layout.hpp"
+#include <array>
+#include <cstdint>
+
+#include <class/hid/hid_device.h>
+
+#include "KeyEvent.hpp"
 
 namespace usb_hid {
 
+// Keyboard usages covered by the NKRO report, every key in the layout must be
+// below this
+static constexpr uint8_t NKRO_USAGES_NUM = 0x90;
+
 struct KbHidReport {
-    std::array<uint8_t, layout::COLUMNS_NUM * layout::ROWS_NUM> keys;
+    // One bit per keyboard usage
+    std::array<uint8_t, NKRO_USAGES_NUM / 8> keys;
     uint16_t consumerCode;
-    uint16_t size;
     uint8_t modifiers;
+
+    void AddKey(uint8_t usage) {
+        if (usage != HID_KEY_NONE && usage < NKRO_USAGES_NUM) {
+            keys[usage / 8] |= 1 << (usage % 8);
+        }
+    }
+
+    void RemoveKey(uint8_t usage) {
+        if (usage < NKRO_USAGES_NUM) {
+            keys[usage / 8] &= ~(1 << (usage % 8));
+        }
+    }
 };
 
-bool SendReport(KbHidReport);
+// Hands a key change to the USB task. Never drops the event, if the USB task
+// falls behind this waits for it.
+void SendKeyEvent(const KeyEvent& event);
+
+// Logs the bytes of a report sent to the host
+void PrintReport(const uint8_t* report, uint16_t size);
 
 bool SetupTask();
 
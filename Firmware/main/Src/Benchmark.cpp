@@ -0,0 +1,59 @@
+#include "Benchmark.hpp"
+
+#ifdef CONFIG_KEYBOARD_BENCHMARK
+
+#include <esp_log.h>
+
+#include "BenchmarkMeasure.hpp"
+#include "DeferredLog.hpp"
+#include "KeyBitmap.hpp"
+#include "MatrixIo.hpp"
+#include "UsbHid.hpp"
+
+namespace benchmark {
+
+static constexpr uint32_t ITERATIONS     = 1000;
+static constexpr uint32_t LOG_ITERATIONS = 20;
+
+// Only the pins are set up, matrix_io::Init() belongs to the matrix task,
+// which installs the row interrupts on its own core
+static void MeasureMatrix() {
+    Measure("matrix_read", ITERATIONS, [] {
+        const KeyBitmap raw = matrix_io::Read();
+        asm volatile("" : : "r"(&raw) : "memory");
+    });
+    Measure("matrix_read_per_pin", ITERATIONS, [] {
+        const KeyBitmap raw = matrix_io::ReadPerPin();
+        asm volatile("" : : "r"(&raw) : "memory");
+    });
+}
+
+static void MeasureLogs() {
+    const uint8_t report[1 + usb_hid::NKRO_USAGES_NUM / 8] = {};
+    Measure("print_report", LOG_ITERATIONS, [&] {
+        usb_hid::PrintReport(report, sizeof(report));
+    });
+    Measure("deferred_log_report", LOG_ITERATIONS, [&] {
+        deferred_log::LogBytes(deferred_log::Message::ReportSent,
+                               report,
+                               sizeof(report));
+    });
+    // Those reports were never sent, they must not be printed once the drain
+    // task starts
+    deferred_log::Discard();
+}
+
+void Run() {
+    // Unconfigured rows may float, the scans would not see an idle matrix
+    if (!matrix_io::SetupPins()) {
+        ESP_LOGE("Benchmark", "Matrix pins setup failed");
+        return;
+    }
+    MeasureMatrix();
+    RunPortable();
+    MeasureLogs();
+}
+
+} // namespace benchmark
+
+#endif
@@ -0,0 +1,143 @@
+#include "Benchmark.hpp"
+
+#ifdef CONFIG_KEYBOARD_BENCHMARK
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+
+#include "SpscRing.hpp"
+
+#include "BenchmarkMeasure.hpp"
+#include "Debounce.hpp"
+#include "KeyBitmap.hpp"
+#include "KeyEvent.hpp"
+#include "Keymap.hpp"
+#include "Layout.hpp"
+#include "MatrixIo.hpp"
+#include "MatrixScan.hpp"
+#include "UsbHid.hpp"
+
+namespace benchmark {
+
+static constexpr uint32_t ITERATIONS = 1000;
+
+// Pressed key counts of the keymap benchmarks, followed by a case pressing
+// every plain key
+static constexpr std::array<uint8_t, 3> pressedKeysNums = {0, 6, 20};
+// Debounce time of the scan benchmarks, as in the matrix task
+static constexpr uint8_t DEBOUNCE_TIME_MS = 5;
+
+// Keys that only change the report, so pressing them has no side effect
+static KeyBitmap GetPlainKeys() {
+    KeyBitmap keys;
+    for (uint8_t column = 0; column < layout::COLUMNS_NUM; ++column) {
+        for (uint8_t row = 0; row < layout::ROWS_NUM; ++row) {
+            const Key& key = layout::layers[layout::BASE_LAYER][column][row];
+            if (key.GetType() == KeyType::Keyboard ||
+                key.GetType() == KeyType::Modifier) {
+                keys.Set(KeyBitmap::Index(column, row));
+            }
+        }
+    }
+    return keys;
+}
+
+static void MeasureDebounce() {
+    debounce::Debouncer debouncer(debounce::Algorithm::EagerPerKey,
+                                  DEBOUNCE_TIME_MS);
+    const KeyBitmap idle;
+    uint32_t now = 0;
+    Measure("debounce_idle", ITERATIONS, [&] {
+        debouncer.Update(idle, now++);
+    });
+}
+
+// Presses then releases the keys, one event each, as the USB task does for a
+// scan where they all changed
+static void MeasureKeymapKeys(const char* name,
+                              const std::array<uint8_t, KeyBitmap::SIZE>& keys,
+                              uint8_t keysNum) {
+    usb_hid::KbHidReport report = {};
+    Measure(name, ITERATIONS, [&] {
+        for (uint8_t i = 0; i < keysNum; ++i) {
+            keymap::ProcessEvent({0, keys[i], true}, false, report);
+        }
+        for (uint8_t i = 0; i < keysNum; ++i) {
+            keymap::ProcessEvent({0, keys[i], false}, false, report);
+        }
+    });
+}
+
+static void MeasureKeymap() {
+    std::array<uint8_t, KeyBitmap::SIZE> keys;
+    uint8_t keysNum = 0;
+    GetPlainKeys().ForEach([&](uint8_t index) { keys[keysNum++] = index; });
+
+    char name[32];
+    for (uint8_t pressedKeysNum : pressedKeysNums) {
+        snprintf(name, sizeof(name), "keymap_%u_keys", pressedKeysNum);
+        MeasureKeymapKeys(name, keys, std::min(pressedKeysNum, keysNum));
+    }
+    // The layout has fewer plain keys than matrix positions: empty positions,
+    // layer, consumer and action keys are left out, as pressing them has side
+    // effects. This is the most keys one scan can change without them.
+    snprintf(name, sizeof(name), "keymap_all_%u_plain_keys", keysNum);
+    MeasureKeymapKeys(name, keys, keysNum);
+}
+
+// What the matrix task does on every scan, read the matrix and run the scan
+// step, while nothing changes and while a key changes on every scan. The
+// events are dropped.
+static void MeasureScan() {
+    static int64_t clockUs;
+    matrix_scan::Scanner scanner(
+        debounce::Algorithm::EagerPerKey,
+        DEBOUNCE_TIME_MS,
+        [] { return clockUs; },
+        []([[maybe_unused]] const KeyEvent& event) {});
+
+    Measure("scan_idle", ITERATIONS, [&] {
+        scanner.Update(matrix_io::Read());
+    });
+
+    // Each change comes after the debounce time of the previous one, so
+    // every scan gives an event
+    bool isPressed = false;
+    Measure("scan_key_change", ITERATIONS, [&] {
+        clockUs += 2 * DEBOUNCE_TIME_MS * 1000;
+        isPressed     = !isPressed;
+        KeyBitmap raw = matrix_io::Read();
+        raw.Set(0, isPressed);
+        scanner.Update(raw);
+    });
+}
+
+// The hand-off of key events from the matrix task to the USB task, one event
+// and a whole matrix worth of them
+static void MeasureRing() {
+    static SpscRing<KeyEvent, 128> ring;
+    const KeyEvent event = {0, 0, true};
+    Measure("ring_push_pop", ITERATIONS, [&] {
+        ring.Push(event);
+        ring.Pop();
+    });
+    Measure("ring_push_pop_matrix", ITERATIONS, [&] {
+        for (uint8_t i = 0; i < layout::COLUMNS_NUM * layout::ROWS_NUM; ++i) {
+            ring.Push(event);
+        }
+        while (ring.Pop()) {
+        }
+    });
+}
+
+void RunPortable() {
+    MeasureDebounce();
+    MeasureScan();
+    MeasureKeymap();
+    MeasureRing();
+}
+
+} // namespace benchmark
+
+#endif
@@ -0,0 +1,173 @@
+#include "Combos.hpp"
+
+namespace combos {
+
+// Keys that belong to at least one combo
+static constexpr KeyBitmap comboKeys = [] {
+    KeyBitmap keys;
+    for (const Combo& combo : layout::combos) {
+        keys |= combo.keys;
+    }
+    return keys;
+}();
+
+// For every key, the set of combos it belongs to
+static constexpr auto combosOfKey = [] {
+    std::array<std::array<uint32_t, (layout::COMBOS_NUM + 31) / 32>,
+               KeyBitmap::SIZE>
+        sets = {};
+    for (uint16_t combo = 0; combo < layout::COMBOS_NUM; ++combo) {
+        layout::combos[combo].keys.ForEach([&](uint8_t key) {
+            sets[key][combo / 32] |= 1u << (combo % 32);
+        });
+    }
+    return sets;
+}();
+
+ComboDetector::ComboDetector(uint16_t termMs, Output output)
+    : m_termUs(termMs * 1000),
+      m_output(output) {}
+
+void ComboDetector::Process(const KeyEvent& event) {
+    if (IsPending() && IsExpired(event.timestamp)) {
+        Resolve();
+    }
+
+    if (!IsPending()) {
+        if (!event.isPressed && ProcessActiveRelease(event)) {
+            return;
+        }
+        if (!event.isPressed || !comboKeys.Test(event.key)) {
+            m_output(event);
+            return;
+        }
+        m_buffer[m_bufferSize++] = event;
+        m_bufferedKeys           = {static_cast<uint8_t>(event.key)};
+        m_candidates             = combosOfKey[event.key];
+        return;
+    }
+
+    // Only more presses of keys in the candidate combos can complete one
+    bool isCandidate = event.isPressed && m_bufferSize < BUFFER_SIZE;
+    if (isCandidate) {
+        ComboSet candidates = m_candidates;
+        uint32_t any        = 0;
+        for (uint16_t i = 0; i < WORDS_NUM; ++i) {
+            candidates[i] &= combosOfKey[event.key][i];
+            any |= candidates[i];
+        }
+        isCandidate = any;
+        if (isCandidate) {
+            m_candidates = candidates;
+        }
+    }
+    if (!isCandidate) {
+        Resolve();
+        Process(event);
+        return;
+    }
+
+    m_buffer[m_bufferSize++] = event;
+    m_bufferedKeys.Set(event.key);
+    bool isLargerPossible = false;
+    if (FindComboMatch(isLargerPossible) >= 0 && !isLargerPossible) {
+        Resolve();
+    }
+}
+
+void ComboDetector::Update(uint32_t nowUs) {
+    if (IsPending() && IsExpired(nowUs)) {
+        Resolve();
+    }
+}
+
+// Compared as signed, nowUs may be a bit before the first press held back
+// when the caller keeps a margin on the clock, and must not wrap into an
+// expired term
+bool ComboDetector::IsExpired(uint32_t nowUs) const {
+    return static_cast<int32_t>(nowUs - m_buffer[0].timestamp) >=
+           static_cast<int32_t>(m_termUs);
+}
+
+void ComboDetector::Resolve() {
+    bool isLargerPossible = false;
+    const int32_t combo   = FindComboMatch(isLargerPossible);
+    if (combo >= 0 && Fire(combo)) {
+        return;
+    }
+
+    // Replayed presses may start a new combo and be held back again
+    const std::array<KeyEvent, BUFFER_SIZE> buffer = m_buffer;
+    const uint8_t bufferSize                       = m_bufferSize;
+    m_bufferSize                                   = 0;
+    m_output(buffer[0]);
+    for (uint8_t i = 1; i < bufferSize; ++i) {
+        Process(buffer[i]);
+    }
+}
+
+// Returns the candidate whose keys are exactly the held back ones, -1 if
+// none. isLargerPossible tells whether other candidates need more keys.
+int32_t ComboDetector::FindComboMatch(bool& isLargerPossible) const {
+    int32_t match = -1;
+    for (uint16_t i = 0; i < WORDS_NUM; ++i) {
+        uint32_t word = m_candidates[i];
+        while (word) {
+            const uint16_t combo = i * 32 + __builtin_ctz(word);
+            word &= word - 1;
+            if (layout::combos[combo].keys == m_bufferedKeys) {
+                match = combo;
+            } else {
+                isLargerPossible = true;
+            }
+        }
+    }
+    return match;
+}
+
+// Returns false if too many combos are held down already
+bool ComboDetector::Fire(uint16_t combo) {
+    for (ActiveCombo& active : m_active) {
+        if (!active.keys.Any()) {
+            const uint32_t timestamp = m_buffer[m_bufferSize - 1].timestamp;
+            m_bufferSize             = 0;
+            active                   = {
+                combo,
+                m_bufferedKeys,
+                true,
+            };
+            m_output({
+                .timestamp = timestamp,
+                .key       = combo,
+                .isPressed = true,
+                .isCombo   = true,
+            });
+            return true;
+        }
+    }
+    return false;
+}
+
+// The combo is released with the first of its keys, the releases of the
+// other keys are swallowed. Returns whether the event was part of a combo.
+bool ComboDetector::ProcessActiveRelease(const KeyEvent& event) {
+    for (ActiveCombo& active : m_active) {
+        if (!active.keys.Test(event.key)) {
+            continue;
+        }
+        active.keys.Set(event.key, false);
+        if (active.isPressed) {
+            active.isPressed = false;
+            m_output({
+                .timestamp = event.timestamp,
+                .key       = active.combo,
+                .isPressed = false,
+                .isCombo   = true,
+            });
+        }
+        return true;
+    }
+    return false;
+}
+
+} // namespace combos
@@ -0,0 +1,92 @@
+#include "Debounce.hpp"
+
+#include <algorithm>
+
+namespace debounce {
+
+Debouncer::Debouncer(Algorithm algorithm, uint8_t timeMs)
+    : m_algorithm(algorithm),
+      m_timeMs(std::min(timeMs, MAX_TIME_MS)) {}
+
+KeyBitmap Debouncer::Update(const KeyBitmap& raw, uint32_t nowMs) {
+    switch (m_algorithm) {
+        case Algorithm::EagerPerKey:
+            return UpdateEagerPerKey(raw, nowMs);
+        case Algorithm::DeferredPerKey:
+            return UpdateDeferredPerKey(raw, nowMs);
+        case Algorithm::DeferredGlobal:
+            return UpdateDeferredGlobal(raw, nowMs);
+    }
+    return {};
+}
+
+KeyBitmap Debouncer::UpdateEagerPerKey(const KeyBitmap& raw, uint32_t nowMs) {
+    if (m_busy.Any()) {
+        m_busy &= ~ExpiredTimers(nowMs);
+    }
+
+    const KeyBitmap changed = (raw ^ m_state) & ~m_busy;
+    if (changed.Any()) {
+        m_state ^= changed;
+        StartTimers(changed, nowMs);
+    }
+    return changed;
+}
+
+KeyBitmap Debouncer::UpdateDeferredPerKey(const KeyBitmap& raw,
+                                          uint32_t nowMs) {
+    const KeyBitmap bounced = raw ^ m_lastRaw;
+    if (bounced.Any()) {
+        m_lastRaw = raw;
+        StartTimers(bounced, nowMs);
+    }
+    if (!m_busy.Any()) {
+        return {};
+    }
+
+    const KeyBitmap settled = ExpiredTimers(nowMs);
+    m_busy &= ~settled;
+
+    const KeyBitmap changed = (raw ^ m_state) & settled;
+    m_state ^= changed;
+    return changed;
+}
+
+KeyBitmap Debouncer::UpdateDeferredGlobal(const KeyBitmap& raw,
+                                          uint32_t nowMs) {
+    if (!(raw == m_lastRaw)) {
+        m_lastRaw        = raw;
+        m_globalDeadline = nowMs + m_timeMs;
+        m_globalBusy     = true;
+    }
+    if (!m_globalBusy ||
+        static_cast<int32_t>(nowMs - m_globalDeadline) < 0) {
+        return {};
+    }
+
+    m_globalBusy            = false;
+    const KeyBitmap changed = raw ^ m_state;
+    m_state                 = raw;
+    return changed;
+}
+
+void Debouncer::StartTimers(const KeyBitmap& keys, uint32_t nowMs) {
+    const uint8_t deadline = nowMs + m_timeMs;
+    keys.ForEach([&](uint8_t index) {
+        m_deadlines[index] = deadline;
+    });
+    m_busy |= keys;
+}
+
+KeyBitmap Debouncer::ExpiredTimers(uint32_t nowMs) const {
+    KeyBitmap expired;
+    const uint8_t now = nowMs;
+    m_busy.ForEach([&](uint8_t index) {
+        if (static_cast<int8_t>(now - m_deadlines[index]) >= 0) {
+            expired.Set(index);
+        }
+    });
+    return expired;
+}
+
+} // namespace debounce
@@ -0,0 +1,191 @@
+#include "DeferredLog.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+
+#include <esp_timer.h>
+
+#include "RtosUtils.hpp"
+#include "SpscRing.hpp"
+#include "TaskPlan.hpp"
+
+#include "KeyBitmap.hpp"
+#include "Layout.hpp"
+#include "UsbHid.hpp"
+
+namespace deferred_log {
+
+// Time left for more entries to gather once some have been printed
+static constexpr std::chrono::milliseconds DRAIN_PERIOD(10);
+static constexpr uint32_t RING_SIZE   = 64;
+static constexpr uint8_t PAYLOAD_SIZE = 24;
+
+struct MessageInfo {
+    Subsystem subsystem;
+    esp_log_level_t level;
+};
+
+static constexpr MessageInfo messages[] = {
+    // KeyChanged
+    {Subsystem::Matrix, ESP_LOG_INFO},
+    // ReportSent
+    {Subsystem::UsbHid, ESP_LOG_INFO},
+};
+
+struct Entry {
+    uint32_t timestamp;
+    Message message;
+    uint8_t size;
+    // Raw arguments or bytes, as given to the log call
+    std::array<uint8_t, PAYLOAD_SIZE> payload;
+};
+
+struct Channel {
+    SpscRing<Entry, RING_SIZE> ring;
+    std::atomic<esp_log_level_t> level = ESP_LOG_INFO;
+    // Entries lost because the ring was full, reported by the drain task
+    std::atomic<uint32_t> dropped;
+};
+
+static bool Init();
+static void Handler();
+static void Push(Message message, const void* data, uint8_t size);
+static bool Drain();
+static void Print(const Entry& entry);
+
+static rtos::Task<4096> task("DeferredLogTask",
+                             task_plan::LOG.priority,
+                             Init,
+                             Handler,
+                             task_plan::LOG.core);
+
+static std::array<Channel, SUBSYSTEMS_NUM> channels;
+
+// With every ring empty the drain task waits without a timeout, so it does
+// not wake the chip up while nothing is logged. It raises isDrainWaiting
+// first, and the next push gives the notification.
+static rtos::Notify drainNotify(task_plan::LOG_DRAIN_NOTIFY);
+static std::atomic<bool> isDrainWaiting;
+
+void SetLevel(Subsystem subsystem, esp_log_level_t level) {
+    channels[static_cast<uint8_t>(subsystem)].level = level;
+}
+
+void Log(Message message, uint32_t arg0, uint32_t arg1) {
+    const uint32_t args[] = {arg0, arg1};
+    Push(message, args, sizeof(args));
+}
+
+void LogBytes(Message message, const void* data, uint8_t size) {
+    Push(message, data, size < PAYLOAD_SIZE ? size : PAYLOAD_SIZE);
+}
+
+void Discard() {
+    for (Channel& channel : channels) {
+        while (channel.ring.Pop()) {
+        }
+        channel.dropped = 0;
+    }
+}
+
+static void Push(Message message, const void* data, uint8_t size) {
+    const MessageInfo& info = messages[static_cast<uint8_t>(message)];
+    Channel& channel        = channels[static_cast<uint8_t>(info.subsystem)];
+    if (info.level > channel.level.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    Entry entry = {
+        .timestamp = static_cast<uint32_t>(esp_timer_get_time()),
+        .message   = message,
+        .size      = size,
+    };
+    memcpy(entry.payload.data(), data, size);
+    if (!channel.ring.Push(entry)) {
+        channel.dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Pairs with the fence in Handler(): either this sees the flag raised,
+    // or the drain task sees the entry before it waits
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (isDrainWaiting.load(std::memory_order_relaxed) &&
+        isDrainWaiting.exchange(false, std::memory_order_relaxed)) {
+        drainNotify.Give();
+    }
+}
+
+static bool Init() {
+    drainNotify.Bind();
+    return true;
+}
+
+static void Handler() {
+    if (Drain()) {
+        rtos::Delay(DRAIN_PERIOD);
+        return;
+    }
+
+    isDrainWaiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Entries pushed before the flag was raised did not give
+    if (Drain()) {
+        isDrainWaiting.store(false, std::memory_order_relaxed);
+        return;
+    }
+    drainNotify.Wait();
+}
+
+// Prints every entry recorded so far, returns whether there was any
+static bool Drain() {
+    bool isAnyPrinted = false;
+    for (Channel& channel : channels) {
+        while (auto entry = channel.ring.Pop()) {
+            Print(*entry);
+            isAnyPrinted = true;
+        }
+        const uint32_t dropped = channel.dropped.exchange(0);
+        if (dropped) {
+            ESP_LOGW("DeferredLog", "%" PRIu32 " entries dropped", dropped);
+            isAnyPrinted = true;
+        }
+    }
+    return isAnyPrinted;
+}
+
+static void Print(const Entry& entry) {
+    switch (entry.message) {
+        case Message::KeyChanged: {
+            std::array<uint32_t, 2> args;
+            memcpy(args.data(), entry.payload.data(), sizeof(args));
+            const uint8_t column = KeyBitmap::Column(args[0]);
+            const uint8_t row    = KeyBitmap::Row(args[0]);
+            const Key& key = layout::layers[layout::BASE_LAYER][column][row];
+            ESP_LOGI(key.GetText(),
+                     "has been %s at %" PRIu32
+                     " us. ID = %d. Row = %d, Column = %d.",
+                     args[1] ? "pressed" : "released",
+                     entry.timestamp,
+                     key.GetCode(),
+                     row,
+                     column);
+            break;
+        }
+        case Message::ReportSent:
+            usb_hid::PrintReport(entry.payload.data(), entry.size);
+            break;
+        default:
+            break;
+    }
+}
+
+bool SetupTask() {
+    if (!task.Setup()) {
+        return false;
+    }
+    return true;
+}
+
+} // namespace deferred_log
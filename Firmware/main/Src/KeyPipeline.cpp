@@ -0,0 +1,116 @@
+#include "KeyPipeline.hpp"
+
+#include <algorithm>
+
+#include "Combos.hpp"
+#include "TapHold.hpp"
+
+#include "Keymap.hpp"
+#include "Latency.hpp"
+#include "Macros.hpp"
+
+namespace key_pipeline {
+
+static constexpr uint16_t COMBO_TERM_MS   = 50;
+static constexpr auto TAP_HOLD_MODE       = tap_hold::Mode::PermissiveHold;
+static constexpr uint16_t TAPPING_TERM_MS = 200;
+// Events are timestamped when their scan starts and reach the ring a bit
+// later, so the clock alone only expires a combo or tapping term once no
+// event from before the deadline can still be on its way
+static constexpr uint32_t EVENT_DELAY_MARGIN_US = 1000;
+
+static void ProcessTapHold(const KeyEvent& event);
+static void ApplyKeyEvent(const KeyEvent& event, bool isHold);
+static void PostReport();
+static uint32_t GetTimeTo(uint32_t deadline, uint32_t nowUs);
+
+static combos::ComboDetector comboDetector(COMBO_TERM_MS, ProcessTapHold);
+static tap_hold::TapHold tapHold(TAP_HOLD_MODE,
+                                 TAPPING_TERM_MS,
+                                 keymap::IsTapHoldKey,
+                                 ApplyKeyEvent);
+
+static ReportSink reportSink;
+static usb_hid::KbHidReport kbHidReport;
+static bool isKbHidReportChanged;
+static uint32_t lastEventTimestamp;
+
+void Init(ReportSink sink) {
+    reportSink = sink;
+}
+
+// Events go through combo detection, then tap-hold decisions, then the
+// keymap
+void Process(const KeyEvent& event) {
+    comboDetector.Process(event);
+}
+
+void Update(uint32_t nowUs) {
+    const uint32_t expiredUs = nowUs - EVENT_DELAY_MARGIN_US;
+    comboDetector.Update(expiredUs);
+    tapHold.Update(expiredUs);
+
+    if (isKbHidReportChanged) {
+        PostReport();
+        isKbHidReportChanged = false;
+    }
+}
+
+uint32_t GetTimeToDeadline(uint32_t nowUs) {
+    uint32_t time = UINT32_MAX;
+    if (comboDetector.IsPending()) {
+        time = std::min(time, GetTimeTo(comboDetector.GetDeadline(), nowUs));
+    }
+    if (tapHold.IsPending()) {
+        time = std::min(time, GetTimeTo(tapHold.GetDeadline(), nowUs));
+    }
+    return time;
+}
+
+void Repost() {
+    PostReport();
+}
+
+void StepMacro(uint32_t nowUs) {
+    if (macros::Step(nowUs)) {
+        PostReport();
+    }
+}
+
+static void ProcessTapHold(const KeyEvent& event) {
+    tapHold.Process(event);
+}
+
+// Receives the events in order once their tap-hold decisions are taken.
+// Changes seen in the same scan share a timestamp and go in one report, later
+// ones get their own so no press or release is merged away.
+static void ApplyKeyEvent(const KeyEvent& event, bool isHold) {
+    if (isKbHidReportChanged && event.timestamp != lastEventTimestamp) {
+        PostReport();
+    }
+    keymap::ProcessEvent(event, isHold, kbHidReport);
+    lastEventTimestamp   = event.timestamp;
+    isKbHidReportChanged = true;
+}
+
+// Merges the typed keys with the ones held by a macro
+static void PostReport() {
+    const usb_hid::KbHidReport& macroReport = macros::GetReport();
+    usb_hid::KbHidReport report             = kbHidReport;
+    report.modifiers |= macroReport.modifiers;
+    for (uint8_t byte = 0; byte < report.keys.size(); ++byte) {
+        report.keys[byte] |= macroReport.keys[byte];
+    }
+
+    if (reportSink(report) && isKbHidReportChanged) {
+        latency::OnReportPosted(lastEventTimestamp);
+    }
+}
+
+static uint32_t GetTimeTo(uint32_t deadline, uint32_t nowUs) {
+    const int32_t remaining =
+        static_cast<int32_t>(deadline + EVENT_DELAY_MARGIN_US - nowUs);
+    return remaining > 0 ? remaining : 0;
+}
+
+} // namespace key_pipeline
@@ -0,0 +1,154 @@
+#include "Keymap.hpp"
+
+#include <array>
+
+#include "KeyBitmap.hpp"
+#include "Latency.hpp"
+#include "Layers.hpp"
+#include "Layout.hpp"
+#include "Leds.hpp"
+#include "Macros.hpp"
+#include "Power.hpp"
+
+namespace keymap {
+
+static const Key& GetKey(uint8_t index);
+static void DoAction(Action action, bool isPressed);
+
+static constexpr bool IsValid(const Key& key) {
+    if (key.GetType() == KeyType::Keyboard &&
+        key.GetCode() >= usb_hid::NKRO_USAGES_NUM) {
+        return false;
+    }
+    if (key.GetTapCode() >= usb_hid::NKRO_USAGES_NUM) {
+        return false;
+    }
+    return key.GetType() != KeyType::Macro ||
+           key.GetCode() < layout::MACROS_NUM;
+}
+
+static_assert([] {
+    for (const auto& layer : layout::layers) {
+        for (const auto& column : layer) {
+            for (const Key& key : column) {
+                if (!IsValid(key)) {
+                    return false;
+                }
+            }
+        }
+    }
+    for (const Combo& combo : layout::combos) {
+        if (!IsValid(combo.key)) {
+            return false;
+        }
+    }
+    return true;
+}(), "Layout uses a usage the NKRO report can not hold or a missing macro");
+
+// Everything that changes at runtime, the layout itself is constant
+static struct {
+    // Layer each key was resolved on when pressed, so its release undoes the
+    // same thing even if the active layers changed in between
+    std::array<uint8_t, KeyBitmap::SIZE> pressedLayers;
+} state;
+
+bool IsTapHoldKey(uint8_t index) {
+    const Key& key = layout::layers[layers::Resolve(index)]
+                                   [KeyBitmap::Column(index)]
+                                   [KeyBitmap::Row(index)];
+    return key.IsTapHoldKey();
+}
+
+void ProcessEvent(const KeyEvent& event,
+                  bool isHold,
+                  usb_hid::KbHidReport& report) {
+    if (event.isPressed && !event.isCombo) {
+        state.pressedLayers[event.key] = layers::Resolve(event.key);
+    }
+    const Key& key = event.isCombo ? layout::combos[event.key].key
+                                   : GetKey(event.key);
+
+    // Dual-function keys behave as one of the plain types
+    KeyType type     = key.GetType();
+    uint16_t code    = key.GetCode();
+    uint8_t modifier = key.GetModifier();
+    if (key.IsTapHoldKey()) {
+        if (!isHold) {
+            type = KeyType::Keyboard;
+            code = key.GetTapCode();
+        } else if (type == KeyType::ModTap) {
+            type = KeyType::Modifier;
+        } else {
+            type = KeyType::LayerMomentary;
+        }
+    }
+
+    if (type >= KeyType::LayerMomentary) {
+        layers::ProcessLayerKey(type, key.GetLayer(), event.isPressed);
+        return;
+    }
+    if (event.isPressed) {
+        layers::OnKeyPressed();
+    }
+
+    switch (type) {
+        case KeyType::Keyboard:
+            if (event.isPressed) {
+                report.AddKey(code);
+            } else {
+                report.RemoveKey(code);
+            }
+            break;
+        case KeyType::Modifier:
+            if (event.isPressed) {
+                report.modifiers = report.modifiers | modifier;
+            } else {
+                report.modifiers = report.modifiers & ~modifier;
+            }
+            break;
+        case KeyType::Consumer:
+            if (event.isPressed) {
+                report.consumerCode = code;
+            } else if (report.consumerCode == code) {
+                report.consumerCode = 0;
+            }
+            break;
+        case KeyType::Action:
+            DoAction(key.GetAction(), event.isPressed);
+            break;
+        case KeyType::Macro:
+            if (event.isPressed) {
+                macros::Play(code);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Entry of the key in the layer it was pressed on
+static const Key& GetKey(uint8_t index) {
+    return layout::layers[state.pressedLayers[index]]
+                         [KeyBitmap::Column(index)][KeyBitmap::Row(index)];
+}
+
+static void DoAction(Action action, bool isPressed) {
+    switch (action) {
+        case Action::DecreaseBrightness:
+            leds::DecreaseBrightness(isPressed);
+            break;
+        case Action::IncreaseBrightness:
+            leds::IncreaseBrightness(isPressed);
+            break;
+        case Action::PrintLatency:
+            if (isPressed) {
+                latency::Print();
+                power::PrintStats();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+} // namespace keymap
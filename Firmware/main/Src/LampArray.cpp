@@ -0,0 +1,235 @@
+#include "LampArray.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstring>
+
+#include "Key.hpp"
+#include "Layout.hpp"
+#include "Leds.hpp"
+#include "Rgb.hpp"
+
+namespace lamp_array {
+
+// Feature reports, without the report ID which TinyUSB handles
+
+struct [[gnu::packed]] AttributesReport {
+    uint16_t lampCount;
+    uint32_t widthUm;
+    uint32_t heightUm;
+    uint32_t depthUm;
+    uint32_t kind;
+    uint32_t minUpdateIntervalUs;
+};
+
+struct [[gnu::packed]] AttributesRequestReport {
+    uint16_t lampId;
+};
+
+struct [[gnu::packed]] AttributesResponseReport {
+    uint16_t lampId;
+    uint32_t positionXUm;
+    uint32_t positionYUm;
+    uint32_t positionZUm;
+    uint32_t updateLatencyUs;
+    uint32_t purposes;
+    uint8_t redLevels;
+    uint8_t greenLevels;
+    uint8_t blueLevels;
+    uint8_t intensityLevels;
+    uint8_t isProgrammable;
+    uint8_t inputBinding;
+};
+
+struct [[gnu::packed]] LampColor {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+    uint8_t intensity;
+};
+
+struct [[gnu::packed]] MultiUpdateReport {
+    uint8_t lampCount;
+    uint8_t flags;
+    std::array<uint16_t, MULTI_UPDATE_LAMPS> lampIds;
+    std::array<LampColor, MULTI_UPDATE_LAMPS> colors;
+};
+
+struct [[gnu::packed]] RangeUpdateReport {
+    uint8_t flags;
+    uint16_t lampIdStart;
+    uint16_t lampIdEnd;
+    LampColor color;
+};
+
+struct [[gnu::packed]] ControlReport {
+    uint8_t autonomousMode;
+};
+
+static constexpr uint32_t KIND_KEYBOARD       = 1;
+static constexpr uint32_t PURPOSE_CONTROL     = 0x01;
+static constexpr uint32_t PURPOSE_STATUS      = 0x08;
+static constexpr uint8_t FLAG_UPDATE_COMPLETE = 0x01;
+
+// Keys are assumed on a regular 19.05 mm grid, the status LED sits above the
+// last column
+static constexpr uint32_t KEY_PITCH_UM = 19050;
+static constexpr uint32_t WIDTH_UM     = layout::COLUMNS_NUM * KEY_PITCH_UM;
+static constexpr uint32_t HEIGHT_UM    = layout::ROWS_NUM * KEY_PITCH_UM;
+static constexpr uint32_t DEPTH_UM     = 30000;
+
+static constexpr uint32_t FRAME_PERIOD_US =
+    std::chrono::microseconds(leds::FRAME_PERIOD).count();
+
+// Every report plus its ID must fit the HID control transfer buffer
+static_assert(1 + sizeof(MultiUpdateReport) <= CFG_TUD_HID_EP_BUFSIZE);
+static_assert(1 + sizeof(AttributesResponseReport) <= CFG_TUD_HID_EP_BUFSIZE);
+
+static AttributesResponseReport GetLampAttributes(uint16_t lampId);
+static uint8_t GetInputBinding(const Key& key);
+static void SetLamp(uint16_t lampId, const LampColor& color);
+
+// Lamp described by the next attributes response, set by the host and then
+// advanced after every response so it can walk all lamps
+static uint16_t nextLampId;
+
+uint16_t GetReport(uint8_t reportId, uint8_t* buffer, uint16_t size) {
+    if (reportId == ATTRIBUTES_REPORT_ID) {
+        const AttributesReport report = {
+            .lampCount           = leds::LAMPS_NUM,
+            .widthUm             = WIDTH_UM,
+            .heightUm            = HEIGHT_UM,
+            .depthUm             = DEPTH_UM,
+            .kind                = KIND_KEYBOARD,
+            .minUpdateIntervalUs = FRAME_PERIOD_US,
+        };
+        if (size < sizeof(report)) {
+            return 0;
+        }
+        memcpy(buffer, &report, sizeof(report));
+        return sizeof(report);
+    }
+    if (reportId == ATTRIBUTES_RESPONSE_REPORT_ID) {
+        const AttributesResponseReport report = GetLampAttributes(nextLampId);
+        if (size < sizeof(report)) {
+            return 0;
+        }
+        memcpy(buffer, &report, sizeof(report));
+        nextLampId = (nextLampId + 1) % leds::LAMPS_NUM;
+        return sizeof(report);
+    }
+    return 0;
+}
+
+bool SetReport(uint8_t reportId, const uint8_t* buffer, uint16_t size) {
+    if (reportId == ATTRIBUTES_REQUEST_REPORT_ID) {
+        AttributesRequestReport report;
+        if (size < sizeof(report)) {
+            return false;
+        }
+        memcpy(&report, buffer, sizeof(report));
+        nextLampId = report.lampId < leds::LAMPS_NUM ? report.lampId : 0;
+        return true;
+    }
+    if (reportId == MULTI_UPDATE_REPORT_ID) {
+        MultiUpdateReport report;
+        if (size < sizeof(report)) {
+            return false;
+        }
+        memcpy(&report, buffer, sizeof(report));
+        if (report.lampCount > MULTI_UPDATE_LAMPS) {
+            return false;
+        }
+        for (uint8_t i = 0; i < report.lampCount; i++) {
+            SetLamp(report.lampIds[i], report.colors[i]);
+        }
+        if (report.flags & FLAG_UPDATE_COMPLETE) {
+            leds::CommitLamps();
+        }
+        return true;
+    }
+    if (reportId == RANGE_UPDATE_REPORT_ID) {
+        RangeUpdateReport report;
+        if (size < sizeof(report)) {
+            return false;
+        }
+        memcpy(&report, buffer, sizeof(report));
+        if (report.lampIdStart > report.lampIdEnd ||
+            report.lampIdEnd >= leds::LAMPS_NUM) {
+            return false;
+        }
+        for (uint16_t id = report.lampIdStart; id <= report.lampIdEnd; id++) {
+            SetLamp(id, report.color);
+        }
+        if (report.flags & FLAG_UPDATE_COMPLETE) {
+            leds::CommitLamps();
+        }
+        return true;
+    }
+    if (reportId == CONTROL_REPORT_ID) {
+        ControlReport report;
+        if (size < sizeof(report)) {
+            return false;
+        }
+        memcpy(&report, buffer, sizeof(report));
+        leds::SetAutonomous(report.autonomousMode != 0);
+        return true;
+    }
+    return false;
+}
+
+static AttributesResponseReport GetLampAttributes(uint16_t lampId) {
+    AttributesResponseReport report = {
+        .lampId          = lampId,
+        .positionXUm     = WIDTH_UM - KEY_PITCH_UM / 2,
+        .positionYUm     = 0,
+        .positionZUm     = DEPTH_UM,
+        .updateLatencyUs = FRAME_PERIOD_US,
+        .purposes        = PURPOSE_STATUS,
+        .redLevels       = UINT8_MAX,
+        .greenLevels     = UINT8_MAX,
+        .blueLevels      = UINT8_MAX,
+        .intensityLevels = 1,
+        .isProgrammable  = 1,
+        .inputBinding    = 0,
+    };
+    if (lampId == 0) {
+        return report;
+    }
+
+    // Key lamps are chained column by column, see leds::KeyLamp()
+    const uint8_t column = (lampId - 1) / layout::ROWS_NUM;
+    const uint8_t row    = (lampId - 1) % layout::ROWS_NUM;
+    report.positionXUm   = column * KEY_PITCH_UM + KEY_PITCH_UM / 2;
+    report.positionYUm   = row * KEY_PITCH_UM + KEY_PITCH_UM / 2;
+    report.purposes      = PURPOSE_CONTROL;
+    report.inputBinding =
+        GetInputBinding(layout::layers[layout::BASE_LAYER][column][row]);
+    return report;
+}
+
+// Keyboard usage of the key under a lamp, 0 if it does not send one
+static uint8_t GetInputBinding(const Key& key) {
+    switch (key.GetType()) {
+        case KeyType::Keyboard:
+            return key.GetCode();
+        case KeyType::Modifier:
+            return key.GetModifier() ? HID_KEY_CONTROL_LEFT +
+                                           __builtin_ctz(key.GetModifier())
+                                     : 0;
+        default:
+            return 0;
+    }
+}
+
+// Lamps report a single intensity level, so the intensity only switches the
+// colour on or off. Hosts may send it as 1 or 255, any nonzero value is on.
+static void SetLamp(uint16_t lampId, const LampColor& color) {
+    if (!color.intensity) {
+        leds::SetLamp(lampId, {0, 0, 0});
+        return;
+    }
+    leds::SetLamp(lampId, {color.red, color.green, color.blue});
+}
+
+} // namespace lamp_array
@@ -0,0 +1,136 @@
+#include "Latency.hpp"
+
+#ifdef CONFIG_KEYBOARD_LATENCY_STATS
+
+#include <array>
+#include <atomic>
+#include <cinttypes>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+namespace latency {
+
+// Bucket 0 holds durations below 16 us, bucket N those from 2^(N+3) us to
+// twice that, the last one everything from 2^18 us (262 ms)
+static constexpr uint8_t BUCKETS_NUM        = 16;
+static constexpr uint8_t FIRST_BUCKET_SHIFT = 4;
+
+// Each stage is only recorded by one task, so the counters are plain words.
+// Print() may read a histogram in the middle of an update, which only skews
+// that one line.
+struct Histogram {
+    std::array<uint32_t, BUCKETS_NUM> buckets;
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;
+};
+
+static const char* const stageNames[STAGES_NUM] = {
+    "debounce",
+    "hand-off",
+    "report",
+    "transfer",
+    "total",
+};
+
+static std::array<Histogram, STAGES_NUM> histograms;
+
+// Report queued in a slot and not handed to TinyUSB yet. Only used by the
+// USB task.
+static bool isPosted;
+static uint32_t postedTimestamp;
+
+// Report handed to TinyUSB. Written by the USB task before tud_hid_report and
+// read by TinyUSB once the transfer completes, and no new transfer starts
+// before that.
+static std::atomic<bool> isInFlight;
+static uint32_t inFlightTimestamp;
+static uint32_t inFlightSentAt;
+
+void Record(Stage stage, uint32_t durationUs) {
+    const uint8_t log2 = 31 - __builtin_clz(durationUs | 1);
+    uint8_t bucket     = 0;
+    if (log2 >= FIRST_BUCKET_SHIFT) {
+        bucket = log2 - FIRST_BUCKET_SHIFT + 1;
+        if (bucket >= BUCKETS_NUM) {
+            bucket = BUCKETS_NUM - 1;
+        }
+    }
+
+    Histogram& histogram = histograms[static_cast<uint8_t>(stage)];
+    ++histogram.buckets[bucket];
+    ++histogram.count;
+    histogram.sum += durationUs;
+    if (durationUs > histogram.max) {
+        histogram.max = durationUs;
+    }
+}
+
+void OnReportPosted(uint32_t eventTimestamp) {
+    // Reports are sent in order, so the oldest change gives the latency
+    if (!isPosted) {
+        isPosted        = true;
+        postedTimestamp = eventTimestamp;
+    }
+}
+
+void OnReportSending() {
+    if (!isPosted) {
+        return;
+    }
+    isPosted           = false;
+    const uint32_t now = esp_timer_get_time();
+    inFlightTimestamp  = postedTimestamp;
+    inFlightSentAt     = now;
+    Record(Stage::Report, now - postedTimestamp);
+    isInFlight.store(true, std::memory_order_release);
+}
+
+void OnReportSendFailed() {
+    if (isInFlight.exchange(false, std::memory_order_acquire)) {
+        // Sent again later, still counted from the same change
+        isPosted        = true;
+        postedTimestamp = inFlightTimestamp;
+    }
+}
+
+void OnReportComplete() {
+    if (!isInFlight.load(std::memory_order_acquire)) {
+        return;
+    }
+    const uint32_t now = esp_timer_get_time();
+    Record(Stage::Transfer, now - inFlightSentAt);
+    Record(Stage::Total, now - inFlightTimestamp);
+    isInFlight.store(false, std::memory_order_release);
+}
+
+// One line per stage, in microseconds, followed by the bucket counts
+void Print() {
+    for (uint8_t stage = 0; stage < STAGES_NUM; ++stage) {
+        const Histogram& histogram = histograms[stage];
+
+        uint16_t textIndex         = 0;
+        std::array<char, 160> text = {""};
+        for (uint32_t bucket : histogram.buckets) {
+            textIndex += snprintf(&text[textIndex],
+                                  sizeof(text) - textIndex,
+                                  "%" PRIu32 " ",
+                                  bucket);
+        }
+        ESP_LOGI("Latency",
+                 "%s: count %" PRIu32 ", avg %" PRIu32 ", max %" PRIu32
+                 ", buckets %s",
+                 stageNames[stage],
+                 histogram.count,
+                 histogram.count
+                     ? static_cast<uint32_t>(histogram.sum / histogram.count)
+                     : 0,
+                 histogram.max,
+                 text.data());
+    }
+}
+
+} // namespace latency
+
+#endif
@@ -0,0 +1,109 @@
+#include "Layers.hpp"
+
+#include <array>
+
+#include "KeyBitmap.hpp"
+#include "Layout.hpp"
+
+namespace layers {
+
+static void ProcessOneShot(uint8_t layer, bool isPressed);
+
+// For every key, the layers where it is not transparent
+static constexpr auto opaqueLayers = [] {
+    std::array<uint16_t, KeyBitmap::SIZE> masks = {};
+    for (uint8_t layer = 0; layer < layout::LAYERS_NUM; ++layer) {
+        for (uint8_t column = 0; column < layout::COLUMNS_NUM; ++column) {
+            for (uint8_t row = 0; row < layout::ROWS_NUM; ++row) {
+                const Key& key = layout::layers[layer][column][row];
+                if (key.GetType() != KeyType::Transparent) {
+                    masks[KeyBitmap::Index(column, row)] |= 1 << layer;
+                }
+            }
+        }
+    }
+    return masks;
+}();
+
+static struct {
+    // Momentary, toggled and one-shot layers
+    uint16_t active;
+    uint8_t defaultLayer;
+
+    uint16_t oneShot;
+    bool isOneShotHeld;
+    bool isOneShotUsed;
+} state;
+
+uint8_t Resolve(uint8_t key) {
+    const uint16_t candidates =
+        (state.active | (1 << state.defaultLayer)) & opaqueLayers[key];
+    if (!candidates) {
+        return state.defaultLayer;
+    }
+    return 31 - __builtin_clz(candidates);
+}
+
+void ProcessLayerKey(KeyType type, uint8_t layer, bool isPressed) {
+    if (layer >= layout::LAYERS_NUM) {
+        return;
+    }
+    const uint16_t mask = 1 << layer;
+
+    switch (type) {
+        case KeyType::LayerMomentary:
+            if (isPressed) {
+                state.active |= mask;
+            } else {
+                state.active &= ~mask;
+            }
+            break;
+        case KeyType::LayerToggle:
+            if (isPressed) {
+                state.active ^= mask;
+            }
+            break;
+        case KeyType::LayerOneShot:
+            ProcessOneShot(layer, isPressed);
+            break;
+        case KeyType::LayerDefault:
+            if (isPressed) {
+                state.defaultLayer = layer;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void OnKeyPressed() {
+    if (!state.oneShot) {
+        return;
+    }
+    state.isOneShotUsed = true;
+    if (!state.isOneShotHeld) {
+        state.active &= ~state.oneShot;
+        state.oneShot = 0;
+    }
+}
+
+// The layer stays active until the next key press. If that key is pressed
+// while the one-shot key is still held it behaves as a momentary layer.
+static void ProcessOneShot(uint8_t layer, bool isPressed) {
+    if (isPressed) {
+        state.active &= ~state.oneShot;
+        state.oneShot       = 1 << layer;
+        state.active       |= state.oneShot;
+        state.isOneShotHeld = true;
+        state.isOneShotUsed = false;
+        return;
+    }
+
+    state.isOneShotHeld = false;
+    if (state.isOneShotUsed) {
+        state.active &= ~state.oneShot;
+        state.oneShot = 0;
+    }
+}
+
+} // namespace layers
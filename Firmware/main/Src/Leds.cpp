@@ -1,8 +1,13 @@
 #include "Leds.hpp"
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 
+#include "LedStrip.hpp"
+#include "Layout.hpp"
 #include "RtosUtils.hpp"
-#include "led_strip.h"
+#include "TaskPlan.hpp"
 #include <esp_log.h>
 
 #include <driver/gpio.h>
@@ -16,31 +21,96 @@ static constexpr auto CAPS_LED_PIN   = GPIO_NUM_39;
 static bool Init();
 static void Handler();
 
-static void DelayAndWaitNewCommand(const TickType_t ticksToDelay);
-
-static void ShowCapsOnUsb();
-static void ShowCapsOnBle();
-static void ShowUsb();
-static void ShowBluetoothSearching();
-static void ShowBluetoothConnected();
-static void ShowRainbow();
-static void ShowError();
+static void ApplyRequests();
+static bool IsAnimated(Mode mode);
+static void SetFrameTimer(bool isRunning);
+static void OnFrameTimer();
+static Rgb RenderFrame(TickType_t elapsed);
+static Rgb RenderRainbow(TickType_t elapsed);
+static void DrawFrame(TickType_t elapsed);
+static void DrawLamps();
+static void ClearStrips();
+static void RefreshStrips();
+static Rgb Scale(const Rgb& color);
 static void SetCapsKey(bool);
-static void DecreaseIncreaseBrightness(bool isIncrease);
-
-static led_strip_handle_t rgbHandle;
-
-static rtos::Task task(taskName, 4096, 24, Init, Handler);
-static rtos::Queue<Commands> requests(1);
+static void ChangeBrightness(int32_t steps);
+
+// Animations are drawn every FRAME_PERIOD as a function of the time spent in
+// the current mode, in full scale colours that are scaled to the brightness
+// last. Their speed and CPU cost do not depend on the brightness.
+// Time for the rainbow to go once around the colour wheel
+static constexpr std::chrono::milliseconds RAINBOW_PERIOD(3000);
+static constexpr std::chrono::milliseconds BLINK_PERIOD(250);
+
+static constexpr TickType_t RAINBOW_TICKS =
+    pdMS_TO_TICKS(RAINBOW_PERIOD.count());
+static constexpr TickType_t BLINK_TICKS = pdMS_TO_TICKS(BLINK_PERIOD.count());
+
+static Strip<1> statusStrip;
+
+#ifdef CONFIG_KEYBOARD_KEY_LEDS
+static constexpr auto KEY_LEDS_PIN =
+    static_cast<gpio_num_t>(CONFIG_KEYBOARD_KEY_LEDS_GPIO);
+// Each column runs the animation this much later than the previous one, so
+// it sweeps across the board
+static constexpr TickType_t KEY_LEDS_COLUMN_DELAY = pdMS_TO_TICKS(100);
+
+static Strip<KEY_LEDS_NUM> keyStrip;
+static_assert(Strip<KEY_LEDS_NUM>::TRANSFER_TIME < FRAME_PERIOD,
+              "The key LEDs cannot be refreshed once per frame");
+#endif
+
+static rtos::Task<4096> task(taskName,
+                             task_plan::LEDS.priority,
+                             Init,
+                             Handler,
+                             task_plan::LEDS.core);
+// Given by the frame timer and by every request
+static rtos::Notify frameTick(task_plan::LEDS_FRAME_NOTIFY);
+static rtos::Timer frameTimer("LedsFrame", FRAME_PERIOD, true, OnFrameTimer);
+
+// Mailbox written by the other tasks and read once per wake up
+static std::atomic<Mode> requestedMode = Mode::NotConnected;
+static std::atomic<bool> requestedCapsLock;
+static std::atomic<bool> requestedSuspended;
+static std::atomic<int32_t> requestedBrightnessSteps;
+
+static Mode currentMode;
+static bool isCapsLockOn;
+static bool isSuspended;
+static TickType_t modeStart;
+
+// Lamp colours set by the host through the LampArray interface. They are
+// staged by the TinyUSB task and copied to shownLamps by this task once per
+// frame.
+static std::atomic<bool> isAutonomous = true;
+static std::atomic<bool> isLampsCommitted;
+static portMUX_TYPE lampsLock = portMUX_INITIALIZER_UNLOCKED;
+static std::array<Rgb, LAMPS_NUM> stagedLamps;
+static std::array<Rgb, LAMPS_NUM> shownLamps;
+
+// Brightness levels go from 0 to MAX_INDEX, level n being 2^(n+1) - 1
+static constexpr int32_t MAX_INDEX     = 7;
+static constexpr int32_t DEFAULT_INDEX = 2;
+static uint8_t brightness              = (1 << (DEFAULT_INDEX + 1)) - 1;
+
+void SetMode(Mode mode) {
+    requestedMode = mode;
+    frameTick.Give();
+}
 
-static Commands currentMode;
+Mode GetMode() {
+    return requestedMode;
+}
 
-static uint8_t dimmLevel;
-static constexpr int8_t DEFAULT_INDEX = 2;
-static uint8_t brightness             = (1 << (DEFAULT_INDEX + 1)) - 1;
+void SetCapsLock(bool isOn) {
+    requestedCapsLock = isOn;
+    frameTick.Give();
+}
 
-bool SendCommand(Commands mode) {
-    return requests.Send(mode);
+void SetSuspended(bool value) {
+    requestedSuspended = value;
+    frameTick.Give();
 }
 
 void IncreaseBrightness(bool isPressed) {
@@ -54,7 +124,8 @@ void IncreaseBrightness(bool isPressed) {
         return;
     }
 
-    SendCommand(Commands::IncreaseBrightness);
+    requestedBrightnessSteps++;
+    frameTick.Give();
     commandDone = true;
 }
 
@@ -69,29 +140,38 @@ void DecreaseBrightness(bool isPressed) {
         return;
     }
 
-    SendCommand(Commands::DecreaseBrightness);
+    requestedBrightnessSteps--;
+    frameTick.Give();
     commandDone = true;
 }
 
-// Since this is a simple variable that only changes in one place there is no
-// need for synchronization
-Commands GetMode() {
-    return currentMode;
+void SetAutonomous(bool value) {
+    isAutonomous = value;
+    frameTick.Give();
 }
 
-static bool Init() {
-    const led_strip_config_t stripConfig = {
-        .strip_gpio_num   = STATUS_LED_PIN,
-        .max_leds         = 1,
-        .led_pixel_format = LED_PIXEL_FORMAT_GRB,
-        .led_model        = LED_MODEL_WS2812,
-        .flags            = {.invert_out = false},
-    };
-    // Using default settings
-    const led_strip_rmt_config_t rmtConfig = {};
+void SetLamp(uint16_t lamp, const Rgb& color) {
+    if (lamp >= LAMPS_NUM) {
+        return;
+    }
+    portENTER_CRITICAL(&lampsLock);
+    stagedLamps[lamp] = color;
+    portEXIT_CRITICAL(&lampsLock);
+}
 
-    led_strip_new_rmt_device(&stripConfig, &rmtConfig, &rgbHandle);
-    led_strip_clear(rgbHandle);
+void CommitLamps() {
+    isLampsCommitted = true;
+}
+
+static bool Init() {
+    if (!statusStrip.Setup(STATUS_LED_PIN, LED_MODEL_WS2812, false)) {
+        return false;
+    }
+#ifdef CONFIG_KEYBOARD_KEY_LEDS
+    if (!keyStrip.Setup(KEY_LEDS_PIN, LED_MODEL_SK6812, true)) {
+        return false;
+    }
+#endif
 
     const gpio_config_t config = {
         .pin_bit_mask = BIT64(CAPS_LED_PIN),
@@ -102,172 +182,201 @@ static bool Init() {
     };
     gpio_config(&config);
 
+    currentMode = Mode::NotConnected;
+    modeStart   = xTaskGetTickCount();
     SetCapsKey(false);
 
-    currentMode = Commands::NotConnected;
+    frameTick.Bind();
+    // Requests made before binding did not wake this task up
+    frameTick.Give();
 
     return true;
 }
 
 static void Handler() {
-    switch (currentMode) {
-        case Commands::CapsOnUsb:
-            ShowCapsOnUsb();
-            break;
-        case Commands::CapsOnBle:
-            ShowCapsOnBle();
-            break;
-        case Commands::Usb:
-            ShowUsb();
-            break;
-        case Commands::BluetoothSearching:
-            ShowBluetoothSearching();
-            break;
-        case Commands::BluetoothConnected:
-            ShowBluetoothConnected();
-            break;
-        case Commands::NotConnected:
-            ShowRainbow();
-            break;
-        case Commands::Error:
-            ShowError();
-            break;
-        default:
-            DelayAndWaitNewCommand(0xFFFFFFFF);
-            break;
+    frameTick.Wait();
+
+    ApplyRequests();
+
+    if (isSuspended) {
+        SetFrameTimer(false);
+        ClearStrips();
+        return;
     }
-}
 
-static void DelayAndWaitNewCommand(const TickType_t ticksToDelay) {
-    auto newCommand = requests.Wait(ticksToDelay);
-    if (newCommand) {
-        if (*newCommand == Commands::DecreaseBrightness ||
-            *newCommand == Commands::IncreaseBrightness) {
-            DecreaseIncreaseBrightness(*newCommand ==
-                                       Commands::IncreaseBrightness);
-        } else {
-            currentMode = newCommand.value();
-        }
+    const bool isHostDriven = !isAutonomous;
+    // Static modes are drawn once, on the wake up that sets them, and then the
+    // task sleeps until the next request
+    SetFrameTimer(isHostDriven || IsAnimated(currentMode));
+    if (isHostDriven) {
+        DrawLamps();
+    } else {
+        DrawFrame(xTaskGetTickCount() - modeStart);
     }
 }
 
-static void ShowCapsOnUsb() {
-    led_strip_set_pixel(rgbHandle, 0, brightness, brightness, 0);
-    led_strip_refresh(rgbHandle);
+// Takes everything requested since the last wake up at once
+static void ApplyRequests() {
+    const int32_t steps = requestedBrightnessSteps.exchange(0);
+    if (steps) {
+        ChangeBrightness(steps);
+    }
 
-    SetCapsKey(true);
+    const bool capsLock  = requestedCapsLock;
+    const bool suspended = requestedSuspended;
+    if (capsLock != isCapsLockOn || suspended != isSuspended) {
+        isCapsLockOn = capsLock;
+        isSuspended  = suspended;
+        SetCapsKey(isCapsLockOn && !isSuspended);
+    }
 
-    DelayAndWaitNewCommand(0xFFFFFFFF);
+    const Mode mode = requestedMode;
+    if (mode != currentMode) {
+        currentMode = mode;
+        modeStart   = xTaskGetTickCount();
+        // A host that goes away can not give the lamps back
+        if (currentMode == Mode::NotConnected) {
+            isAutonomous = true;
+        }
+    }
 }
 
-static void ShowCapsOnBle() {
-    led_strip_set_pixel(rgbHandle, 0, brightness, 0, brightness);
-    led_strip_refresh(rgbHandle);
+static bool IsAnimated(Mode mode) {
+    return mode == Mode::BluetoothSearching || mode == Mode::NotConnected;
+}
 
-    SetCapsKey(true);
+static void SetFrameTimer(bool isRunning) {
+    static bool isTimerRunning;
 
-    DelayAndWaitNewCommand(0xFFFFFFFF);
+    if (isRunning == isTimerRunning) {
+        return;
+    }
+    if (isRunning) {
+        frameTimer.Start();
+    } else {
+        frameTimer.Stop();
+    }
+    isTimerRunning = isRunning;
 }
 
-static void ShowUsb() {
-    led_strip_set_pixel(rgbHandle, 0, 0, brightness, 0);
-    led_strip_refresh(rgbHandle);
+static void OnFrameTimer() {
+    frameTick.Give();
+}
 
-    SetCapsKey(false);
+// Returns the colour of the current mode at full brightness
+static Rgb RenderFrame(TickType_t elapsed) {
+    static constexpr uint8_t FULL = UINT8_MAX;
 
-    DelayAndWaitNewCommand(0xFFFFFFFF);
+    switch (currentMode) {
+        case Mode::Usb:
+            return isCapsLockOn ? Rgb{FULL, FULL, 0} : Rgb{0, FULL, 0};
+        case Mode::Error:
+            return {0, FULL, 0};
+        case Mode::BluetoothSearching:
+            return (elapsed / BLINK_TICKS) % 2 ? Rgb{FULL, 0, 0}
+                                              : Rgb{0, 0, FULL};
+        case Mode::BluetoothConnected:
+            return isCapsLockOn ? Rgb{FULL, 0, FULL} : Rgb{0, 0, FULL};
+        case Mode::NotConnected:
+            return RenderRainbow(elapsed);
+        default:
+            return {};
+    }
 }
 
-static void ShowBluetoothSearching() {
-    static bool state;
-    if (state) {
-        led_strip_set_pixel(rgbHandle, 0, 0, 0, brightness);
-        led_strip_refresh(rgbHandle);
-    } else {
-        led_strip_set_pixel(rgbHandle, 0, brightness, 0, 0);
-        led_strip_refresh(rgbHandle);
+// Cross fades red to green, green to blue and blue back to red. The position
+// on the wheel is 8.8 fixed point: the integer part is the fade and the
+// fraction how far along it is.
+static Rgb RenderRainbow(TickType_t elapsed) {
+    static constexpr uint32_t FADES = 3;
+
+    const uint32_t position =
+        (elapsed % RAINBOW_TICKS) * (FADES << 8) / RAINBOW_TICKS;
+    const uint8_t rising  = position & 0xFF;
+    const uint8_t falling = UINT8_MAX - rising;
+
+    switch (position >> 8) {
+        case 0:
+            return {falling, rising, 0};
+        case 1:
+            return {0, falling, rising};
+        default:
+            return {rising, 0, falling};
     }
-    state = !state;
-
-    SetCapsKey(false);
+}
 
-    DelayAndWaitNewCommand(250);
+// Renders the frame into the strips, which only send it out if it differs
+// from what they show
+static void DrawFrame(TickType_t elapsed) {
+    statusStrip.Set(0, Scale(RenderFrame(elapsed)));
+
+#ifdef CONFIG_KEYBOARD_KEY_LEDS
+    for (uint8_t column = 0; column < layout::COLUMNS_NUM; column++) {
+        const TickType_t columnElapsed =
+            elapsed + column * KEY_LEDS_COLUMN_DELAY;
+        const Rgb color = Scale(RenderFrame(columnElapsed));
+        for (uint8_t row = 0; row < layout::ROWS_NUM; row++) {
+            keyStrip.Set(column * layout::ROWS_NUM + row, color);
+        }
+    }
+#endif
+    RefreshStrips();
 }
 
-static void ShowBluetoothConnected() {
-    led_strip_set_pixel(rgbHandle, 0, 0, 0, brightness);
+// Shows the lamps last committed by the host. However many updates it sends,
+// they are applied at most once per frame.
+static void DrawLamps() {
+    if (isLampsCommitted.exchange(false)) {
+        portENTER_CRITICAL(&lampsLock);
+        shownLamps = stagedLamps;
+        portEXIT_CRITICAL(&lampsLock);
+    }
 
-    SetCapsKey(false);
+    // Host colours are dimmed by the brightness too, so the keys still limit
+    // the current drawn by the LEDs
+    statusStrip.Set(0, Scale(shownLamps[0]));
+#ifdef CONFIG_KEYBOARD_KEY_LEDS
+    for (uint16_t i = 0; i < KEY_LEDS_NUM; i++) {
+        keyStrip.Set(i, Scale(shownLamps[1 + i]));
+    }
+#endif
+    RefreshStrips();
+}
 
-    DelayAndWaitNewCommand(0xFFFFFFFF);
+static void ClearStrips() {
+    statusStrip.Fill({});
+#ifdef CONFIG_KEYBOARD_KEY_LEDS
+    keyStrip.Fill({});
+#endif
+    RefreshStrips();
 }
 
-static void ShowRainbow() {
-    static enum class State {
-        Start,
-        Red,
-        Green,
-        Blue
-    } state = State::Start;
-
-    if (state == State::Start) {
-        led_strip_set_pixel(rgbHandle, 0, dimmLevel, 0, 0);
-        led_strip_refresh(rgbHandle);
-        dimmLevel++;
-        if (dimmLevel >= brightness) {
-            state     = State::Red;
-            dimmLevel = 0;
-        }
-    } else if (state == State::Red) {
-        led_strip_set_pixel(rgbHandle, 0, brightness - dimmLevel, dimmLevel, 0);
-        led_strip_refresh(rgbHandle);
-        dimmLevel++;
-        if (dimmLevel >= brightness) {
-            state     = State::Green;
-            dimmLevel = 0;
-        }
-    } else if (state == State::Green) {
-        led_strip_set_pixel(rgbHandle, 0, 0, brightness - dimmLevel, dimmLevel);
-        led_strip_refresh(rgbHandle);
-        dimmLevel++;
-        if (dimmLevel >= brightness) {
-            state     = State::Blue;
-            dimmLevel = 0;
-        }
-    } else if (state == State::Blue) {
-        led_strip_set_pixel(rgbHandle, 0, dimmLevel, 0, brightness - dimmLevel);
-        led_strip_refresh(rgbHandle);
-        dimmLevel++;
-        if (dimmLevel >= brightness) {
-            state     = State::Red;
-            dimmLevel = 0;
-        }
-    }
-    DelayAndWaitNewCommand(160 / brightness);
+static void RefreshStrips() {
+    statusStrip.Refresh();
+#ifdef CONFIG_KEYBOARD_KEY_LEDS
+    keyStrip.Refresh();
+#endif
 }
 
-static void ShowError() {
-    led_strip_set_pixel(rgbHandle, 0, 0, brightness, 0);
-    DelayAndWaitNewCommand(0xFFFFFFFF);
+static Rgb Scale(const Rgb& color) {
+    const uint16_t factor = brightness + 1;
+    return {
+        static_cast<uint8_t>((color.red * factor) >> 8),
+        static_cast<uint8_t>((color.green * factor) >> 8),
+        static_cast<uint8_t>((color.blue * factor) >> 8),
+    };
 }
 
 static void SetCapsKey(bool state) {
     gpio_set_level(CAPS_LED_PIN, !state);
 }
 
-static void DecreaseIncreaseBrightness(bool isIncrease) {
-    static constexpr int8_t MAX_INDEX     = 7;
-    static constexpr int8_t DEFAULT_INDEX = 2;
-    static int8_t currentIndex            = DEFAULT_INDEX;
+static void ChangeBrightness(int32_t steps) {
+    static int32_t currentIndex = DEFAULT_INDEX;
 
-    if (isIncrease && currentIndex < MAX_INDEX) {
-        currentIndex++;
-    } else if (!isIncrease && currentIndex > 0) {
-        currentIndex--;
-    }
+    currentIndex = std::clamp(currentIndex + steps, int32_t{0}, MAX_INDEX);
 
     brightness = (1 << (currentIndex + 1)) - 1;
-    dimmLevel  = 0;
 
     ESP_LOGI("Led Brightness", "Set to %d", brightness);
 }
@@ -276,9 +385,6 @@ bool SetupTask() {
     if (!task.Setup()) {
         return false;
     }
-    if (!requests.Setup()) {
-        return false;
-    }
     return true;
 }
 
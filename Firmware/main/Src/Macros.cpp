@@ -0,0 +1,126 @@
+#include "Macros.hpp"
+
+#include <array>
+
+#include "Layout.hpp"
+
+namespace macros {
+
+static constexpr uint8_t QUEUE_SIZE = 8;
+
+static_assert([] {
+    for (const uint8_t* macro : layout::macros) {
+        for (const uint8_t* pc = macro; *pc != MACRO_END; pc += 2) {
+            if (*pc > MACRO_MODIFIERS) {
+                return false;
+            }
+            if (*pc != MACRO_DELAY && *pc != MACRO_MODIFIERS &&
+                pc[1] >= usb_hid::NKRO_USAGES_NUM) {
+                return false;
+            }
+        }
+    }
+    return true;
+}(), "Invalid macro bytecode");
+
+static struct {
+    // Macros waiting to be played, first one being played
+    std::array<uint8_t, QUEUE_SIZE> queue;
+    uint8_t queued;
+
+    // Next instruction of the macro being played, nullptr if none
+    const uint8_t* pc;
+    // Set between the press and the release of MACRO_TAP
+    bool isTapPressed;
+    uint32_t delayStart;
+    uint32_t delay;
+
+    usb_hid::KbHidReport report;
+} state;
+
+void Play(uint8_t macro) {
+    // Presses beyond the queue size are dropped, not worth blocking for
+    if (macro >= layout::MACROS_NUM || state.queued == QUEUE_SIZE) {
+        return;
+    }
+    state.queue[state.queued++] = macro;
+}
+
+bool IsPlaying() {
+    return state.queued;
+}
+
+bool Step(uint32_t nowUs) {
+    while (state.queued) {
+        if (!state.pc) {
+            state.pc = layout::macros[state.queue[0]];
+        }
+        if (GetDelay(nowUs)) {
+            return false;
+        }
+        state.delay = 0;
+
+        // MACRO_END is the only instruction without argument, and the last
+        // byte of the macro
+        if (state.pc[0] == MACRO_END) {
+            // Nothing the macro pressed outlives it
+            const bool isHeld = state.report.modifiers ||
+                                state.report.keys !=
+                                    usb_hid::KbHidReport().keys;
+            state.report = {};
+            state.pc     = nullptr;
+            --state.queued;
+            for (uint8_t i = 0; i < state.queued; ++i) {
+                state.queue[i] = state.queue[i + 1];
+            }
+            if (isHeld) {
+                return true;
+            }
+            continue;
+        }
+
+        const uint8_t op  = state.pc[0];
+        const uint8_t arg = state.pc[1];
+        switch (op) {
+            case MACRO_PRESS:
+                state.report.AddKey(arg);
+                break;
+            case MACRO_RELEASE:
+                state.report.RemoveKey(arg);
+                break;
+            case MACRO_TAP:
+                state.isTapPressed = !state.isTapPressed;
+                if (state.isTapPressed) {
+                    // Same instruction again for the release
+                    state.report.AddKey(arg);
+                    return true;
+                }
+                state.report.RemoveKey(arg);
+                break;
+            case MACRO_DELAY:
+                state.delayStart = nowUs;
+                state.delay      = arg * 1000;
+                state.pc += 2;
+                continue;
+            case MACRO_MODIFIERS:
+                state.report.modifiers = arg;
+                break;
+            default:
+                break;
+        }
+        state.pc += 2;
+        return true;
+    }
+    return false;
+}
+
+uint32_t GetDelay(uint32_t nowUs) {
+    const uint32_t elapsed = nowUs - state.delayStart;
+    return elapsed < state.delay ? state.delay - elapsed : 0;
+}
+
+const usb_hid::KbHidReport& GetReport() {
+    return state.report;
+}
+
+} // namespace macros
@@ -1,146 +1,147 @@
 #include "Matrix.hpp"
 
-#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
 
-#include <class/hid/hid_device.h>
-#include <driver/gpio.h>
-#include <esp_bit_defs.h>
+#include <esp_cpu.h>
+#include <esp_timer.h>
 
 #include <esp_log.h>
 
+#include "Periodic.hpp"
 #include "RtosUtils.hpp"
-
-#include "Layout.hpp"
+#include "TaskPlan.hpp"
+
+#include "Debounce.hpp"
+#include "DeferredLog.hpp"
+#include "KeyBitmap.hpp"
+#include "KeyEvent.hpp"
+#include "MatrixIo.hpp"
+#include "MatrixScan.hpp"
+#include "Power.hpp"
 #include "UsbHid.hpp"
 
 namespace matrix {
 
 static bool Init();
 static void Handler();
-static usb_hid::KbHidReport GenerateReport();
-static bool IsFnPressed();
-
-static rtos::Task task("MatrixTask", 4096, 24, Init, Handler);
-
-static const std::array<gpio_num_t, layout::ROWS_NUM> rows = {
-    GPIO_NUM_14,
-    GPIO_NUM_2,
-    GPIO_NUM_7,
-    GPIO_NUM_6,
-    GPIO_NUM_5,
-    GPIO_NUM_4,
-};
-static const std::array<gpio_num_t, layout::COLUMNS_NUM> columns = {
-    GPIO_NUM_37,
-    GPIO_NUM_36,
-    GPIO_NUM_35,
-    GPIO_NUM_21,
-    GPIO_NUM_1,
-    GPIO_NUM_15,
-    GPIO_NUM_16,
-    GPIO_NUM_17,
-    GPIO_NUM_18,
-    GPIO_NUM_8,
-    GPIO_NUM_9,
-    GPIO_NUM_10,
-    GPIO_NUM_11,
-    GPIO_NUM_12,
-    GPIO_NUM_13,
-};
+static bool Scan();
+static void SendKeyEvent(const KeyEvent& event);
+static void ProfileRead(uint32_t cycles, uint32_t perPinCycles);
+
+static rtos::Task<4096> task("MatrixTask",
+                             task_plan::MATRIX.priority,
+                             Init,
+                             Handler,
+                             task_plan::MATRIX.core);
+
+// While any key is pressed the matrix is scanned every SCAN_PERIOD, paced by
+// a hardware timer, with the CPU at full speed. Once everything has been
+// released for IDLE_TIMEOUT the task stops scanning and sleeps until a row
+// interrupt wakes it up again, letting the chip slow down or sleep too.
+static constexpr std::chrono::microseconds SCAN_PERIOD(250);
+static constexpr std::chrono::microseconds IDLE_TIMEOUT =
+    std::chrono::milliseconds(500);
+
+static constexpr auto DEBOUNCE_ALGORITHM  = debounce::Algorithm::EagerPerKey;
+static constexpr uint8_t DEBOUNCE_TIME_MS = 5;
+
+// Logs the average cost of reading the matrix, next to the old per pin read
+// done right after it, and the scan period stats every PROFILE_READS scans
+static constexpr bool PROFILE_SCAN      = false;
+static constexpr uint32_t PROFILE_READS = 1000;
+
+static rtos::Periodic scanPeriod(SCAN_PERIOD, task_plan::MATRIX_SCAN_NOTIFY);
+static std::atomic<bool> isSuspended;
+
+static matrix_scan::Scanner scanner(DEBOUNCE_ALGORITHM,
+                                    DEBOUNCE_TIME_MS,
+                                    esp_timer_get_time,
+                                    SendKeyEvent);
 
 static bool Init() {
-    gpio_config_t config;
-    config.pull_up_en = GPIO_PULLUP_DISABLE;
-    config.intr_type  = GPIO_INTR_DISABLE;
-
-    config.pull_down_en = GPIO_PULLDOWN_ENABLE;
-    config.mode         = GPIO_MODE_INPUT;
-    for (gpio_num_t gpioNum : rows) {
-        config.pin_bit_mask = BIT64(gpioNum);
-        gpio_config(&config);
-    }
-
-    config.pull_down_en = GPIO_PULLDOWN_DISABLE;
-    config.mode         = GPIO_MODE_OUTPUT;
-    for (gpio_num_t gpioNum : columns) {
-        config.pin_bit_mask = BIT64(gpioNum);
-        gpio_config(&config);
+    if (!matrix_io::Init() || !scanPeriod.Setup()) {
+        return false;
     }
-    return true;
+    power::SetScanning(true);
+    return scanPeriod.Start();
 }
 
 static void Handler() {
-    bool changePresent = false;
-
-    rtos::Delay(5);
-
-    for (uint8_t column = 0; column < layout::COLUMNS_NUM; ++column) {
-        gpio_set_level(columns[column], true);
-        // Quick blocking delay to keep sure gpio is in the correct level
-        volatile uint32_t i = 10;
-        while (i) {
-            i = i - 1;
-        }
-        for (uint8_t row = 0; row < layout::ROWS_NUM; ++row) {
-            Key& key   = layout::keys[column][row];
-            bool state = gpio_get_level(rows[row]);
-            if (state != key.GetState()) {
-                changePresent = true;
-                key.SetState(state);
-                ESP_LOGI(key.GetText(),
-                         "has been %s. ID = %d. Row = %d, Column = %d. GPIO = "
-                         "%d and %d.",
-                         key.GetState() ? "pressed" : "released",
-                         key.GetCode(),
-                         row,
-                         column,
-                         rows[row],
-                         columns[column]);
-            }
-        }
-        gpio_set_level(columns[column], false);
+    static std::chrono::microseconds idleTime;
+
+    if (idleTime >= (isSuspended ? SCAN_PERIOD : IDLE_TIMEOUT)) {
+        scanPeriod.Stop();
+        power::SetScanning(false);
+        matrix_io::WaitForKeyPress();
+        power::SetScanning(true);
+        scanPeriod.Start();
+        idleTime = {};
     }
 
-    if (changePresent) {
-        usb_hid::SendReport(GenerateReport());
+    if (Scan()) {
+        idleTime = {};
+    } else {
+        idleTime += SCAN_PERIOD;
     }
-}
-
-static usb_hid::KbHidReport GenerateReport() {
-    usb_hid::KbHidReport report = {};
 
-    const bool isFnPressed = IsFnPressed();
-
-    for (uint8_t column = 0; column < layout::COLUMNS_NUM; ++column) {
-        for (uint8_t row = 0; row < layout::ROWS_NUM; ++row) {
-            const auto key = layout::keys[column][row];
-
-            if (!key.GetState()) {
-                key.DoFnFunction(false);
-                continue;
-            }
+    scanPeriod.Wait();
+}
 
-            if (!key.GetCode()) {
-                report.modifiers = report.modifiers | key.GetModifier();
-                continue;
-            }
+// Scans the whole matrix and feeds it to the scanner, which sends an event to
+// the USB task for every key whose debounced state changed. Returns whether
+// the matrix must keep being scanned.
+static bool Scan() {
+    const uint32_t startCycles = esp_cpu_get_cycle_count();
+    const KeyBitmap raw        = matrix_io::Read();
+    if (PROFILE_SCAN) {
+        const uint32_t readCycles  = esp_cpu_get_cycle_count() - startCycles;
+        const uint32_t perPinStart = esp_cpu_get_cycle_count();
+        matrix_io::ReadPerPin();
+        ProfileRead(readCycles, esp_cpu_get_cycle_count() - perPinStart);
+    }
+    return scanner.Update(raw);
+}
 
-            if (!isFnPressed) {
-                report.keys[report.size++] = key.GetCode();
-                continue;
-            }
+static void SendKeyEvent(const KeyEvent& event) {
+    usb_hid::SendKeyEvent(event);
+    deferred_log::Log(deferred_log::Message::KeyChanged,
+                      event.key,
+                      event.isPressed);
+}
 
-            report.keys[report.size++] = key.GetFnKeyCode();
-            report.consumerCode        = key.GetFnConsumerCode();
-            key.DoFnFunction(true);
-        }
+static void ProfileRead(uint32_t cycles, uint32_t perPinCycles) {
+    static uint32_t totalCycles;
+    static uint32_t totalPerPinCycles;
+    static uint32_t reads;
+
+    totalCycles += cycles;
+    totalPerPinCycles += perPinCycles;
+    if (++reads == PROFILE_READS) {
+        const rtos::Periodic::Stats& stats = scanPeriod.GetStats();
+        ESP_LOGI("MatrixProfile",
+                 "Matrix read takes %" PRIu32 " cycles on average, %" PRIu32
+                 " per pin. %" PRIu32 " scan periods, %" PRIu32
+                 " overruns, jitter max %" PRIu32 " us, average %" PRIu32
+                 " us",
+                 totalCycles / reads,
+                 totalPerPinCycles / reads,
+                 stats.periods,
+                 stats.overruns,
+                 stats.maxJitterUs,
+                 stats.periods ? static_cast<uint32_t>(stats.totalJitterUs /
+                                                       stats.periods)
+                               : 0);
+        scanPeriod.ResetStats();
+        totalCycles       = 0;
+        totalPerPinCycles = 0;
+        reads             = 0;
     }
-
-    return report;
 }
 
-static bool IsFnPressed() {
-    return layout::keys[1][5].GetState();
+void SetSuspended(bool value) {
+    isSuspended = value;
 }
 
 bool SetupTask() {
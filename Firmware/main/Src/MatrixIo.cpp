@@ -0,0 +1,244 @@
+#include "MatrixIo.hpp"
+
+#include <array>
+
+#include <driver/gpio.h>
+#include <esp_bit_defs.h>
+#include <esp_sleep.h>
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
+
+#include "RtosUtils.hpp"
+#include "TaskPlan.hpp"
+
+#include "Layout.hpp"
+
+namespace matrix_io {
+
+static uint8_t ReadRows();
+static void SetAllColumns(bool level);
+static void SettleDelay();
+static void RowInterruptHandler(void* arg);
+
+static constexpr std::array<gpio_num_t, layout::ROWS_NUM> rows = {
+    GPIO_NUM_14,
+    GPIO_NUM_2,
+    GPIO_NUM_7,
+    GPIO_NUM_6,
+    GPIO_NUM_5,
+    GPIO_NUM_4,
+};
+static constexpr std::array<gpio_num_t, layout::COLUMNS_NUM> columns = {
+    GPIO_NUM_37,
+    GPIO_NUM_36,
+    GPIO_NUM_35,
+    GPIO_NUM_21,
+    GPIO_NUM_1,
+    GPIO_NUM_15,
+    GPIO_NUM_16,
+    GPIO_NUM_17,
+    GPIO_NUM_18,
+    GPIO_NUM_8,
+    GPIO_NUM_9,
+    GPIO_NUM_10,
+    GPIO_NUM_11,
+    GPIO_NUM_12,
+    GPIO_NUM_13,
+};
+
+// The rows are read all at once from the GPIO input register, which only
+// covers GPIOs 0 to 31
+static constexpr uint32_t ROWS_PORT_MASK = [] {
+    uint32_t mask = 0;
+    for (gpio_num_t gpioNum : rows) {
+        mask |= 1u << gpioNum;
+    }
+    return mask;
+}();
+static_assert([] {
+    for (gpio_num_t gpioNum : rows) {
+        if (gpioNum >= 32) {
+            return false;
+        }
+    }
+    return true;
+}());
+
+// Translates each byte of the input register into the rows it holds, so the
+// pins can be remapped with a few table lookups instead of bit by bit
+static constexpr auto rowsLut = [] {
+    std::array<std::array<uint8_t, 256>, 4> lut = {};
+    for (uint8_t row = 0; row < layout::ROWS_NUM; ++row) {
+        const uint8_t byte = rows[row] / 8;
+        const uint8_t bit  = rows[row] % 8;
+        for (uint16_t value = 0; value < 256; ++value) {
+            if (value & (1 << bit)) {
+                lut[byte][value] |= 1 << row;
+            }
+        }
+    }
+    return lut;
+}();
+
+struct ColumnPin {
+    uint32_t setRegister;
+    uint32_t clearRegister;
+    uint32_t mask;
+};
+
+static constexpr auto columnPins = [] {
+    std::array<ColumnPin, layout::COLUMNS_NUM> pins = {};
+    for (uint8_t column = 0; column < layout::COLUMNS_NUM; ++column) {
+        const bool isHighBank = columns[column] >= 32;
+        pins[column]          = {
+            static_cast<uint32_t>(isHighBank ? GPIO_OUT1_W1TS_REG
+                                             : GPIO_OUT_W1TS_REG),
+            static_cast<uint32_t>(isHighBank ? GPIO_OUT1_W1TC_REG
+                                             : GPIO_OUT_W1TC_REG),
+            1u << (columns[column] % 32),
+        };
+    }
+    return pins;
+}();
+
+// Wakes up the task blocked in WaitForKeyPress() on a row interrupt
+static rtos::Notify keyPressNotify(task_plan::MATRIX_KEY_PRESS_NOTIFY);
+
+bool Init() {
+    if (!SetupPins()) {
+        return false;
+    }
+
+    // The ISR service may already have been installed by another module
+    const esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        return false;
+    }
+    for (gpio_num_t gpioNum : rows) {
+        if (gpio_isr_handler_add(gpioNum, RowInterruptHandler, nullptr) !=
+            ESP_OK) {
+            return false;
+        }
+        gpio_intr_disable(gpioNum);
+    }
+    return true;
+}
+
+bool SetupPins() {
+    gpio_config_t config;
+    config.pull_up_en = GPIO_PULLUP_DISABLE;
+
+    // Rows are pulled down, so a key pressed on a driven column pulls its row
+    // high. Only level interrupts can wake the chip from light sleep.
+    config.intr_type    = GPIO_INTR_HIGH_LEVEL;
+    config.pull_down_en = GPIO_PULLDOWN_ENABLE;
+    config.mode         = GPIO_MODE_INPUT;
+    for (gpio_num_t gpioNum : rows) {
+        config.pin_bit_mask = BIT64(gpioNum);
+        gpio_config(&config);
+        if (gpio_wakeup_enable(gpioNum, GPIO_INTR_HIGH_LEVEL) != ESP_OK) {
+            return false;
+        }
+    }
+    if (esp_sleep_enable_gpio_wakeup() != ESP_OK) {
+        return false;
+    }
+
+    config.intr_type    = GPIO_INTR_DISABLE;
+    config.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    config.mode         = GPIO_MODE_OUTPUT;
+    for (gpio_num_t gpioNum : columns) {
+        config.pin_bit_mask = BIT64(gpioNum);
+        gpio_config(&config);
+    }
+
+    // Keep driving the columns and pulling the rows down in light sleep
+    for (gpio_num_t gpioNum : rows) {
+        gpio_sleep_sel_dis(gpioNum);
+    }
+    for (gpio_num_t gpioNum : columns) {
+        gpio_sleep_sel_dis(gpioNum);
+    }
+    return true;
+}
+
+KeyBitmap Read() {
+    KeyBitmap raw;
+    for (uint8_t column = 0; column < layout::COLUMNS_NUM; ++column) {
+        const ColumnPin& pin = columnPins[column];
+        REG_WRITE(pin.setRegister, pin.mask);
+        SettleDelay();
+        raw.SetColumn(column, ReadRows());
+        REG_WRITE(pin.clearRegister, pin.mask);
+    }
+    return raw;
+}
+
+KeyBitmap ReadPerPin() {
+    KeyBitmap raw;
+    for (uint8_t column = 0; column < layout::COLUMNS_NUM; ++column) {
+        gpio_set_level(columns[column], true);
+        SettleDelay();
+        for (uint8_t row = 0; row < layout::ROWS_NUM; ++row) {
+            raw.Set(KeyBitmap::Index(column, row), gpio_get_level(rows[row]));
+        }
+        gpio_set_level(columns[column], false);
+    }
+    return raw;
+}
+
+static uint8_t ReadRows() {
+    const uint32_t port = REG_READ(GPIO_IN_REG);
+    uint8_t state       = 0;
+    for (uint8_t byte = 0; byte < 4; ++byte) {
+        // Resolved at compile time, bytes without any row are skipped
+        if (ROWS_PORT_MASK & (0xFFu << (byte * 8))) {
+            state |= rowsLut[byte][(port >> (byte * 8)) & 0xFF];
+        }
+    }
+    return state;
+}
+
+// Drives every column high and blocks until any row goes high, which means
+// some key has been pressed. The chip may be in light sleep meanwhile.
+void WaitForKeyPress() {
+    keyPressNotify.Bind();
+    SetAllColumns(true);
+    SettleDelay();
+
+    // Drop any notification left from a previous wake up
+    keyPressNotify.Clear();
+    for (gpio_num_t gpioNum : rows) {
+        gpio_intr_enable(gpioNum);
+    }
+    // The interrupts are disabled again by the handler, a key already held
+    // fires it at once
+    keyPressNotify.Wait();
+
+    SetAllColumns(false);
+}
+
+static void SetAllColumns(bool level) {
+    for (const ColumnPin& pin : columnPins) {
+        REG_WRITE(level ? pin.setRegister : pin.clearRegister, pin.mask);
+    }
+}
+
+// Quick blocking delay to keep sure gpio is in the correct level
+static void SettleDelay() {
+    volatile uint32_t i = 10;
+    while (i) {
+        i = i - 1;
+    }
+}
+
+// Level interrupts keep firing while the key is held, so the first one turns
+// all of them off
+static void RowInterruptHandler([[maybe_unused]] void* arg) {
+    for (gpio_num_t gpioNum : rows) {
+        gpio_intr_disable(gpioNum);
+    }
+    portYIELD_FROM_ISR(keyPressNotify.GiveFromIsr());
+}
+
+} // namespace matrix_io
@@ -0,0 +1,49 @@
+#include "MatrixScan.hpp"
+
+#include "Latency.hpp"
+
+namespace matrix_scan {
+
+Scanner::Scanner(debounce::Algorithm algorithm,
+                 uint8_t debounceTimeMs,
+                 Clock clock,
+                 Output output)
+    : m_debouncer(algorithm, debounceTimeMs),
+      m_clock(clock),
+      m_output(output) {}
+
+bool Scanner::Update(const KeyBitmap& raw) {
+    const KeyBitmap rawChanges = raw ^ m_lastRaw;
+    const bool rawChanged      = rawChanges.Any();
+    m_lastRaw                  = raw;
+    if (!rawChanged && !m_debouncer.IsBusy()) {
+        return raw.Any();
+    }
+
+    // The event timestamp wraps every 71 minutes, which its users handle.
+    // The debouncer gets milliseconds from the full clock so its deadlines
+    // never jump back.
+    const int64_t nowUs      = m_clock();
+    const uint32_t timestamp = nowUs;
+    if constexpr (latency::IS_ENABLED) {
+        rawChanges.ForEach(
+            [&](uint8_t index) { m_rawChangeTimes[index] = timestamp; });
+    }
+    const KeyBitmap changed =
+        m_debouncer.Update(raw, static_cast<uint32_t>(nowUs / 1000));
+    if (changed.Any()) {
+        const KeyBitmap& pressed = m_debouncer.GetState();
+        changed.ForEach([&](uint8_t index) {
+            latency::Record(latency::Stage::Debounce,
+                            timestamp - m_rawChangeTimes[index]);
+            m_output({
+                .timestamp = timestamp,
+                .key       = index,
+                .isPressed = pressed.Test(index),
+            });
+        });
+    }
+    return raw.Any() || m_debouncer.IsBusy();
+}
+
+} // namespace matrix_scan
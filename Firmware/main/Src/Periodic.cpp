@@ -0,0 +1,96 @@
+#include "Periodic.hpp"
+
+#include <cstdlib>
+
+#include <esp_timer.h>
+
+namespace rtos {
+
+// One count per microsecond
+static constexpr uint32_t TIMER_RESOLUTION_HZ = 1000000;
+
+bool Periodic::Setup() {
+    if (m_timer) {
+        return true;
+    }
+    m_notify.Bind();
+
+    const gptimer_config_t timerConfig = {
+        .clk_src       = GPTIMER_CLK_SRC_DEFAULT,
+        .direction     = GPTIMER_COUNT_UP,
+        .resolution_hz = TIMER_RESOLUTION_HZ,
+    };
+    if (gptimer_new_timer(&timerConfig, &m_timer) != ESP_OK) {
+        m_timer = nullptr;
+        return false;
+    }
+
+    const gptimer_event_callbacks_t callbacks = {
+        .on_alarm = OnAlarm,
+    };
+    gptimer_alarm_config_t alarmConfig = {
+        .alarm_count  = static_cast<uint64_t>(m_period.count()),
+        .reload_count = 0,
+    };
+    alarmConfig.flags.auto_reload_on_alarm = true;
+    return gptimer_register_event_callbacks(m_timer, &callbacks, this) ==
+               ESP_OK &&
+           gptimer_set_alarm_action(m_timer, &alarmConfig) == ESP_OK;
+}
+
+bool Periodic::Start() {
+    if (m_isRunning) {
+        return true;
+    }
+    m_notify.Clear();
+    m_isLastWakeValid = false;
+    if (gptimer_set_raw_count(m_timer, 0) != ESP_OK ||
+        gptimer_enable(m_timer) != ESP_OK) {
+        return false;
+    }
+    if (gptimer_start(m_timer) != ESP_OK) {
+        gptimer_disable(m_timer);
+        return false;
+    }
+    m_isRunning = true;
+    return true;
+}
+
+bool Periodic::Stop() {
+    if (!m_isRunning) {
+        return true;
+    }
+    m_isRunning = false;
+    return gptimer_stop(m_timer) == ESP_OK &&
+           gptimer_disable(m_timer) == ESP_OK;
+}
+
+void Periodic::Wait() {
+    const uint32_t alarms = m_notify.Wait();
+    const uint32_t now    = esp_timer_get_time();
+
+    ++m_stats.periods;
+    if (alarms > 1) {
+        m_stats.overruns += alarms - 1;
+    }
+    if (m_isLastWakeValid) {
+        const int32_t expected = m_period.count() * alarms;
+        const uint32_t jitter =
+            std::abs(static_cast<int32_t>(now - m_lastWake) - expected);
+        m_stats.totalJitterUs += jitter;
+        if (jitter > m_stats.maxJitterUs) {
+            m_stats.maxJitterUs = jitter;
+        }
+    }
+    m_isLastWakeValid = true;
+    m_lastWake        = now;
+}
+
+bool Periodic::OnAlarm(
+    [[maybe_unused]] gptimer_handle_t timer,
+    [[maybe_unused]] const gptimer_alarm_event_data_t* eventData,
+    void* arg) {
+    return static_cast<Periodic*>(arg)->m_notify.GiveFromIsr();
+}
+
+} // namespace rtos
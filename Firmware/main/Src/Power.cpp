@@ -0,0 +1,94 @@
+#include "Power.hpp"
+
+#ifdef CONFIG_PM_ENABLE
+
+#include <cstdio>
+
+#include <esp_log.h>
+#include <esp_pm.h>
+
+namespace power {
+
+// The ESP32-S3 keeps its APB clock at 80 MHz, which the USB peripheral needs,
+// only while the CPU runs at 80 MHz or more
+static constexpr int MIN_CPU_FREQ_MHZ = 80;
+
+#ifdef CONFIG_FREERTOS_USE_TICKLESS_IDLE
+static constexpr bool IS_LIGHT_SLEEP_ENABLED = true;
+#else
+static constexpr bool IS_LIGHT_SLEEP_ENABLED = false;
+#endif
+
+// esp_pm lock that remembers whether it is held, so setting it twice in a row
+// does not take it twice
+class Lock {
+  public:
+    Lock(esp_pm_lock_type_t type, const char* name)
+        : m_type(type), m_name(name) {}
+
+    bool Setup() {
+        return esp_pm_lock_create(m_type, 0, m_name, &m_handle) == ESP_OK;
+    }
+
+    void Set(bool isHeld) {
+        if (!m_handle || isHeld == m_isHeld) {
+            return;
+        }
+        if (isHeld) {
+            esp_pm_lock_acquire(m_handle);
+        } else {
+            esp_pm_lock_release(m_handle);
+        }
+        m_isHeld = isHeld;
+    }
+
+  private:
+    esp_pm_lock_type_t m_type;
+    const char* m_name;
+    esp_pm_lock_handle_t m_handle = nullptr;
+    bool m_isHeld                 = false;
+};
+
+static Lock scanLock(ESP_PM_CPU_FREQ_MAX, "Scan");
+static Lock transferLock(ESP_PM_CPU_FREQ_MAX, "UsbTransfer");
+static Lock usbLock(ESP_PM_NO_LIGHT_SLEEP, "UsbActive");
+
+bool Init() {
+    if (!scanLock.Setup() || !transferLock.Setup() || !usbLock.Setup()) {
+        ESP_LOGE("Power", "Lock creation failed");
+        return false;
+    }
+    // Held until the USB task sees the bus suspended
+    usbLock.Set(true);
+
+    const esp_pm_config_t config = {
+        .max_freq_mhz       = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz       = MIN_CPU_FREQ_MHZ,
+        .light_sleep_enable = IS_LIGHT_SLEEP_ENABLED,
+    };
+    if (esp_pm_configure(&config) != ESP_OK) {
+        ESP_LOGE("Power", "Configuration failed");
+        return false;
+    }
+    return true;
+}
+
+void SetScanning(bool isScanning) {
+    scanLock.Set(isScanning);
+}
+
+void SetTransferring(bool isTransferring) {
+    transferLock.Set(isTransferring);
+}
+
+void SetUsbActive(bool isActive) {
+    usbLock.Set(isActive);
+}
+
+void PrintStats() {
+    esp_pm_dump_locks(stdout);
+}
+
+} // namespace power
+
+#endif
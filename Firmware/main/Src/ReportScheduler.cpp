@@ -0,0 +1,122 @@
+#include "ReportScheduler.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace usb_hid {
+
+ReportScheduler::ReportScheduler(IsReady isReady,
+                                 Send send,
+                                 WaitReady waitReady)
+    : m_isReady(isReady),
+      m_send(send),
+      m_waitReady(waitReady) {}
+
+bool ReportScheduler::Post(const KbHidReport& report, bool isBootProtocol) {
+    if (!isBootProtocol) {
+        const NkroReport nkroReport = {
+            .modifiers = report.modifiers,
+            .keys      = report.keys,
+        };
+        const bool isKeyboardChanged = PostReport(Slot::Keyboard,
+                                                  KEYBOARD_REPORT_ID,
+                                                  &nkroReport,
+                                                  sizeof(nkroReport));
+        const bool isConsumerChanged = PostReport(Slot::Consumer,
+                                                  CONSUMER_REPORT_ID,
+                                                  &report.consumerCode,
+                                                  sizeof(report.consumerCode));
+        return isKeyboardChanged || isConsumerChanged;
+    }
+
+    // Boot protocol hosts only understand the keyboard report
+    std::array<uint8_t, BOOT_REPORT_SIZE> bootReport = {report.modifiers};
+    uint8_t keysNum                                  = 0;
+    for (uint8_t byte = 0; byte < report.keys.size(); ++byte) {
+        uint8_t bits = report.keys[byte];
+        while (bits) {
+            if (keysNum == BOOT_REPORT_MAX_KEYS) {
+                std::fill(&bootReport[2], bootReport.end(), ROLLOVER_ERROR);
+                break;
+            }
+            bootReport[2 + keysNum++] = byte * 8 + __builtin_ctz(bits);
+            bits &= bits - 1;
+        }
+    }
+    // Boot protocol reports are sent without report ID
+    return PostReport(Slot::Keyboard,
+                      0,
+                      bootReport.data(),
+                      bootReport.size());
+}
+
+void ReportScheduler::Reset() {
+    m_slots = {};
+}
+
+bool ReportScheduler::IsAnyPending() const {
+    return std::any_of(m_slots.begin(),
+                       m_slots.end(),
+                       [](const ReportSlot& slot) { return slot.isPending; });
+}
+
+bool ReportScheduler::Service() {
+    if (!m_isReady()) {
+        return false;
+    }
+    for (ReportSlot& slot : m_slots) {
+        if (!slot.isPending) {
+            continue;
+        }
+        if (!m_send(slot.reportId, slot.pending.data(), slot.size)) {
+            return false;
+        }
+        slot.sent      = slot.pending;
+        slot.isPending = false;
+        return true;
+    }
+    return false;
+}
+
+bool ReportScheduler::Flush() {
+    while (IsAnyPending()) {
+        if (!m_waitReady()) {
+            return false;
+        }
+        // An endpoint that is ready but refuses every report, e.g. during a
+        // bus reset, would be waited for forever
+        if (!Service()) {
+            for (ReportSlot& slot : m_slots) {
+                slot.isPending = false;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+// Stores the latest state of a report ID, merging it with a pending one.
+// If the pending state was never seen by the host it is sent first, so no
+// transition is lost. Returns whether the state changed.
+bool ReportScheduler::PostReport(Slot slotId,
+                                 uint8_t reportId,
+                                 const void* data,
+                                 uint8_t size) {
+    ReportSlot& slot   = m_slots[static_cast<uint8_t>(slotId)];
+    const auto& latest = slot.isPending ? slot.pending : slot.sent;
+    if (slot.reportId == reportId && slot.size == size &&
+        memcmp(latest.data(), data, size) == 0) {
+        return false;
+    }
+
+    if (slot.isPending) {
+        Flush();
+    }
+    slot.reportId = reportId;
+    slot.size     = size;
+    memcpy(slot.pending.data(), data, size);
+    slot.isPending = true;
+    return true;
+}
+
+} // namespace usb_hid
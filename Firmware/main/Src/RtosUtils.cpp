@@ -2,8 +2,12 @@
 
 namespace rtos {
 
-void Delay(const TickType_t ticksToDelay) {
-    vTaskDelay(ticksToDelay / portTICK_PERIOD_MS);
+void Delay(std::chrono::milliseconds time) {
+    vTaskDelay(ToTicks(time));
+}
+
+TickType_t ToTicks(std::chrono::milliseconds time) {
+    return (time.count() * configTICK_RATE_HZ + 999) / 1000;
 }
 
 } // namespace rtos
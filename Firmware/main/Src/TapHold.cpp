@@ -0,0 +1,98 @@
+#include "TapHold.hpp"
+
+namespace tap_hold {
+
+TapHold::TapHold(Mode mode,
+                 uint16_t tappingTermMs,
+                 IsTapHoldKey isTapHoldKey,
+                 Output output)
+    : m_mode(mode),
+      m_tappingTermUs(tappingTermMs * 1000),
+      m_isTapHoldKey(isTapHoldKey),
+      m_output(output) {}
+
+void TapHold::Process(const KeyEvent& event) {
+    if (m_isPending && IsExpired(event.timestamp)) {
+        Resolve(true);
+    }
+
+    if (!m_isPending) {
+        if (event.isPressed && !event.isCombo && m_isTapHoldKey(event.key)) {
+            m_isPending = true;
+            m_pending   = event;
+            m_pressedWhilePending = {};
+            return;
+        }
+        if (event.isCombo) {
+            m_output(event, false);
+            return;
+        }
+        m_output(event, !event.isPressed && m_holds.Test(event.key));
+        if (!event.isPressed) {
+            m_holds.Set(event.key, false);
+        }
+        return;
+    }
+
+    if (event.key == m_pending.key && !event.isCombo) {
+        // Released within the term, this is a tap. The replay may start a
+        // new decision, the release then waits behind it like any other event.
+        Resolve(false);
+        Process(event);
+        return;
+    }
+
+    if (m_bufferSize == BUFFER_SIZE) {
+        // Nothing more can be delayed, decide on what is known so far
+        Resolve(true);
+        Process(event);
+        return;
+    }
+    m_buffer[m_bufferSize++] = event;
+
+    if (event.isCombo) {
+        // Combos only count as another key press
+        if (event.isPressed && m_mode == Mode::HoldOnOtherKeyPress) {
+            Resolve(true);
+        }
+    } else if (event.isPressed) {
+        m_pressedWhilePending.Set(event.key);
+        if (m_mode == Mode::HoldOnOtherKeyPress) {
+            Resolve(true);
+        }
+    } else if (m_mode == Mode::PermissiveHold &&
+               m_pressedWhilePending.Test(event.key)) {
+        Resolve(true);
+    }
+}
+
+void TapHold::Update(uint32_t nowUs) {
+    if (m_isPending && IsExpired(nowUs)) {
+        Resolve(true);
+    }
+}
+
+void TapHold::Resolve(bool isHold) {
+    m_isPending = false;
+    if (isHold) {
+        m_holds.Set(m_pending.key);
+    }
+    m_output(m_pending, isHold);
+
+    // Replayed events may start a new decision and be buffered again
+    const std::array<KeyEvent, BUFFER_SIZE> buffer = m_buffer;
+    const uint8_t bufferSize                       = m_bufferSize;
+    m_bufferSize                                   = 0;
+    for (uint8_t i = 0; i < bufferSize; ++i) {
+        Process(buffer[i]);
+    }
+}
+
+// Compared as signed, nowUs may be a bit before the press when the caller
+// keeps a margin on the clock, and must not wrap into an expired term
+bool TapHold::IsExpired(uint32_t nowUs) const {
+    return static_cast<int32_t>(nowUs - m_pending.timestamp) >=
+           static_cast<int32_t>(m_tappingTermUs);
+}
+
+} // namespace tap_hold
@@ -1,47 +1,131 @@
 #include "UsbHid.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 
 #include <class/hid/hid_device.h>
+#include <driver/gpio.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <sdkconfig.h>
 #include <tinyusb.h>
 
 #include "RtosUtils.hpp"
+#include "TaskPlan.hpp"
+#include "SpscRing.hpp"
 
+#include "DeferredLog.hpp"
+#include "KeyPipeline.hpp"
+#include "LampArray.hpp"
+#include "Latency.hpp"
 #include "Leds.hpp"
+#include "Macros.hpp"
+#include "Matrix.hpp"
+#include "Power.hpp"
+#include "ReportScheduler.hpp"
 
 namespace usb_hid {
 
-static constexpr uint8_t REPORT_MAX_KEYS = 6;
-static constexpr uint8_t REPORT_SIZE     = 2 + REPORT_MAX_KEYS;
+static constexpr uint8_t HID_EP_SIZE = 32;
+
+// D- of the internal USB PHY. The host resumes a suspended bus by driving it
+// high (K state) for at least 20 ms, which wakes the chip from light sleep
+// before the USB peripheral has to see it.
+static constexpr auto USB_DM_PIN = GPIO_NUM_19;
+static_assert(1 + sizeof(NkroReport) <= HID_EP_SIZE);
+
+static constexpr uint8_t POLL_INTERVAL_MS =
+    CONFIG_KEYBOARD_USB_POLL_INTERVAL_MS;
+// Period used to retry sending while the host is not ready
+static constexpr TickType_t RETRY_PERIOD = pdMS_TO_TICKS(100);
 
 static bool Init();
 static void Handler();
 
+static TickType_t GetTimeout(uint32_t remainingUs);
+static void StepMacro();
+static bool IsMacroStepAllowed();
+static TickType_t GetMacroTimeout(uint32_t now);
+static bool PostKbHidReport(const KbHidReport& report);
+static bool IsEndpointReady();
+static bool SendReport(uint8_t reportId, const uint8_t* data, uint8_t size);
+static bool WaitEndpointReady();
 static void PollConnection();
-static void PrintReport(std::array<uint8_t, REPORT_SIZE>& report);
-
-static rtos::Task task("UsbHidTask", 4096, 24, Init, Handler);
+static void OnSuspend(bool isRemoteWakeupAllowed);
+static void OnResume();
+
+static rtos::Task<4096> task("UsbHidTask",
+                             task_plan::USB_HID.priority,
+                             Init,
+                             Handler,
+                             task_plan::USB_HID.core);
 static rtos::Timer pollConnectionTimer("PollConnectionTimer",
-                                       100,
+                                       std::chrono::milliseconds(100),
                                        true,
                                        PollConnection);
-static rtos::Queue<KbHidReport> kbReportsQueue(10);
+// Woken up by new key events and by tud_hid_report_complete_cb
+static rtos::Notify wakeUp(task_plan::USB_HID_WAKE_UP_NOTIFY);
+// Holds several full matrix scans worth of changes
+static SpscRing<KeyEvent, 128> keyEvents;
+
+static ReportScheduler reports(IsEndpointReady,
+                               SendReport,
+                               WaitEndpointReady);
 
 static bool isReady;
 
-// TinyUSB descriptors
+// Set when the host selects another protocol. The reports already built are
+// in the format of the previous one, so they are dropped and the current
+// state is posted again.
+static std::atomic<bool> isProtocolChanged;
+
+// Set by TinyUSB while the host has suspended the bus. Reports stay pending
+// until it resumes, or until a key press asks it to.
+static std::atomic<bool> isSuspended;
+static std::atomic<bool> isRemoteWakeupAllowed;
 
-static constexpr uint8_t KEYBOARD_REPORT_ID = 1;
-static constexpr uint8_t CONSUMER_REPORT_ID = 3;
+// TinyUSB descriptors
 
 static constexpr uint32_t TUSB_DESC_TOTAL_LEN =
     TUD_CONFIG_DESC_LEN + CFG_TUD_HID * TUD_HID_DESC_LEN;
 
 static const uint8_t reportDescriptor[] = {
-    TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(KEYBOARD_REPORT_ID)),
-    TUD_HID_REPORT_DESC_CONSUMER(HID_REPORT_ID(CONSUMER_REPORT_ID))};
+    // Keyboard with one bit per usage (NKRO). In boot protocol the host ignores
+    // this and expects the fixed 8 byte boot report.
+    HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
+    HID_USAGE(HID_USAGE_DESKTOP_KEYBOARD),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+    HID_REPORT_ID(KEYBOARD_REPORT_ID)
+    // Modifiers
+    HID_USAGE_PAGE(HID_USAGE_PAGE_KEYBOARD),
+    HID_USAGE_MIN(224),
+    HID_USAGE_MAX(231),
+    HID_LOGICAL_MIN(0),
+    HID_LOGICAL_MAX(1),
+    HID_REPORT_COUNT(8),
+    HID_REPORT_SIZE(1),
+    HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+    // Keys
+    HID_USAGE_MIN(0),
+    HID_USAGE_MAX(NKRO_USAGES_NUM - 1),
+    HID_REPORT_COUNT(NKRO_USAGES_NUM),
+    HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+    // LEDs
+    HID_USAGE_PAGE(HID_USAGE_PAGE_LED),
+    HID_USAGE_MIN(1),
+    HID_USAGE_MAX(5),
+    HID_REPORT_COUNT(5),
+    HID_OUTPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+    HID_REPORT_COUNT(1),
+    HID_REPORT_SIZE(3),
+    HID_OUTPUT(HID_CONSTANT),
+    HID_COLLECTION_END,
+
+    TUD_HID_REPORT_DESC_CONSUMER(HID_REPORT_ID(CONSUMER_REPORT_ID)),
+
+    TUD_HID_REPORT_DESC_LAMP_ARRAY()};
 
 static const char* stringDescriptor[5] = {
     (char[]){0x09, 0x04}, // 0: is supported language is English (0x0409)
@@ -59,14 +143,27 @@ static const uint8_t configurationDescriptor[] = {
                           TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP,
                           100),
 
-    TUD_HID_DESCRIPTOR(0, 4, false, sizeof(reportDescriptor), 0x81, 16, 10),
+    TUD_HID_DESCRIPTOR(0,
+                       4,
+                       HID_ITF_PROTOCOL_KEYBOARD,
+                       sizeof(reportDescriptor),
+                       0x81,
+                       HID_EP_SIZE,
+                       POLL_INTERVAL_MS),
 };
 
-bool SendReport(KbHidReport kbHidReport) {
-    return kbReportsQueue.Send(kbHidReport);
+void SendKeyEvent(const KeyEvent& event) {
+    while (!keyEvents.Push(event)) {
+        wakeUp.Give();
+        rtos::Delay(std::chrono::milliseconds(1));
+    }
+    // Lost if this task has not started yet, it drains the ring first anyway
+    wakeUp.Give();
 }
 
 static bool Init() {
+    wakeUp.Bind();
+
     const tinyusb_config_t tinyUsbConfig = {
         .device_descriptor = NULL,
         .string_descriptor = stringDescriptor,
@@ -79,54 +176,183 @@ static bool Init() {
     };
     ESP_ERROR_CHECK(tinyusb_driver_install(&tinyUsbConfig));
 
+    // Only the pad input and its wakeup are touched, the pin stays routed to
+    // the PHY. The matrix enables GPIO wakeup itself.
+    if (gpio_input_enable(USB_DM_PIN) != ESP_OK ||
+        gpio_wakeup_enable(USB_DM_PIN, GPIO_INTR_HIGH_LEVEL) != ESP_OK) {
+        return false;
+    }
+
+    key_pipeline::Init(PostKbHidReport);
+
     pollConnectionTimer.Start();
 
     return true;
 }
 
 static void Handler() {
-    static uint16_t lastConsumerCode;
-    static std::array<uint8_t, REPORT_SIZE> keyCodes = {};
+    // Every wake up brings work: key events, a completed transfer or a
+    // deadline
+    power::SetTransferring(true);
 
-    auto report = kbReportsQueue.Wait(100);
-    if (!report) {
-        tud_hid_report(KEYBOARD_REPORT_ID, keyCodes.data(), REPORT_SIZE);
-        return;
+    if (isProtocolChanged.exchange(false)) {
+        reports.Reset();
+        key_pipeline::Repost();
     }
 
-    if (lastConsumerCode != report->consumerCode) {
-        lastConsumerCode = report->consumerCode;
-        tud_hid_report(CONSUMER_REPORT_ID, &lastConsumerCode, 2);
-        ESP_LOGI("ConsumerReport: ", "%d", report->consumerCode);
+    bool isAnyKeyPressed = false;
+    while (auto event = keyEvents.Pop()) {
+        if constexpr (latency::IS_ENABLED) {
+            latency::Record(latency::Stage::HandOff,
+                            esp_timer_get_time() - event->timestamp);
+        }
+        isAnyKeyPressed |= event->isPressed;
+        key_pipeline::Process(*event);
+    }
+    key_pipeline::Update(esp_timer_get_time());
+    StepMacro();
+
+    // Signalled once per suspend, the report goes out when tud_resume_cb
+    // wakes this task up
+    static bool isWakeupSignalled;
+    const bool isBusSuspended = isSuspended;
+    if (!isBusSuspended) {
+        isWakeupSignalled = false;
+    } else if (isAnyKeyPressed && isRemoteWakeupAllowed &&
+               !isWakeupSignalled) {
+        isWakeupSignalled = tud_remote_wakeup();
+    }
+    // Light sleep is only allowed while the bus is suspended, and not once a
+    // remote wakeup has been signalled, as the host then resumes it any time
+    power::SetUsbActive(!isBusSuspended || isWakeupSignalled);
+    if (!isBusSuspended && reports.Service()) {
         return;
     }
+    // Woken up by new key events and by tud_hid_report_complete_cb
+    TickType_t timeout = portMAX_DELAY;
+    if (!isBusSuspended && reports.IsAnyPending()) {
+        timeout =
+            tud_ready() ? pdMS_TO_TICKS(POLL_INTERVAL_MS) + 1 : RETRY_PERIOD;
+    }
+    const uint32_t now  = esp_timer_get_time();
+    const uint32_t time = key_pipeline::GetTimeToDeadline(now);
+    if (time != UINT32_MAX) {
+        timeout = std::min(timeout, GetTimeout(time));
+    }
+    timeout = std::min(timeout, GetMacroTimeout(now));
+    // Keep the CPU at full speed until the host has taken every report
+    power::SetTransferring(tud_ready() && !isBusSuspended &&
+                           (reports.IsAnyPending() || !tud_hid_ready()));
+    wakeUp.Wait(timeout);
+}
+
+static TickType_t GetTimeout(uint32_t remainingUs) {
+    if (!remainingUs) {
+        return 0;
+    }
+    // Rounded up, waking up early would only wait once more
+    return pdMS_TO_TICKS((remainingUs + 999) / 1000) + 1;
+}
+
+// Plays the next step of a macro once the previous one has been handed to
+// the host. Since this task is woken up by every completed transfer, a macro
+// runs at one report per polling interval.
+static void StepMacro() {
+    if (IsMacroStepAllowed()) {
+        key_pipeline::StepMacro(esp_timer_get_time());
+    }
+}
+
+static bool IsMacroStepAllowed() {
+    return macros::IsPlaying() && !reports.IsPending(Slot::Keyboard);
+}
+
+// Time until the next macro step is due. While the keyboard slot is pending
+// the step waits for the transfer instead, whose completion wakes this task
+// up. A due step would otherwise make every wait return at once and the task
+// spin until the endpoint is free.
+static TickType_t GetMacroTimeout(uint32_t now) {
+    if (!IsMacroStepAllowed()) {
+        return portMAX_DELAY;
+    }
+    return GetTimeout(macros::GetDelay(now));
+}
+
+// Returns whether any of the reports changed
+static bool PostKbHidReport(const KbHidReport& report) {
+    return reports.Post(report,
+                        tud_hid_get_protocol() == HID_PROTOCOL_BOOT);
+}
 
-    keyCodes[0] = report->modifiers;
-    memcpy(&keyCodes[2], report->keys.data(), REPORT_MAX_KEYS);
+static bool IsEndpointReady() {
+    return tud_hid_ready();
+}
 
-    tud_hid_report(KEYBOARD_REPORT_ID, keyCodes.data(), REPORT_SIZE);
+static bool SendReport(uint8_t reportId, const uint8_t* data, uint8_t size) {
+    latency::OnReportSending();
+    if (!tud_hid_report(reportId, data, size)) {
+        latency::OnReportSendFailed();
+        return false;
+    }
+    deferred_log::LogBytes(deferred_log::Message::ReportSent, data, size);
+    return true;
+}
 
-    PrintReport(keyCodes);
+// Waits for the previous transfer to be collected by the host, which happens
+// once per polling interval
+static bool WaitEndpointReady() {
+    while (tud_ready() && !tud_hid_ready()) {
+        // Woken up by tud_hid_report_complete_cb. The timeout only covers a
+        // transfer that never completes, e.g. when the bus is reset.
+        wakeUp.Wait(pdMS_TO_TICKS(POLL_INTERVAL_MS) + 1);
+    }
+    return tud_ready();
 }
 
+// Connected means configured by the host, even while the bus is suspended
 static void PollConnection() {
-    const bool tinyUsbReady = tud_ready();
+    const bool tinyUsbReady = tud_mounted();
     if (isReady != tinyUsbReady) {
         isReady = tinyUsbReady;
         if (!isReady) {
             isReady = false;
-            leds::SendCommand(leds::Commands::NotConnected);
-        } else if (leds::GetMode() == leds::Commands::NotConnected) {
-            leds::SendCommand(leds::Commands::Usb);
+            leds::SetMode(leds::Mode::NotConnected);
+        } else if (leds::GetMode() == leds::Mode::NotConnected) {
+            leds::SetMode(leds::Mode::Usb);
         }
     }
 }
 
-static void PrintReport(std::array<uint8_t, REPORT_SIZE>& report) {
+// The host suspends the bus when it sleeps. Everything stops but waiting for
+// a key press, which signals a remote wakeup if the host allowed it. Once the
+// matrix task stops scanning the chip goes to light sleep, woken up by a row
+// or by the host resuming the bus on D-.
+static void OnSuspend(bool isWakeupAllowed) {
+    isRemoteWakeupAllowed = isWakeupAllowed;
+    isSuspended           = true;
+    pollConnectionTimer.Stop();
+    matrix::SetSuspended(true);
+    leds::SetSuspended(true);
+    wakeUp.Give();
+}
+
+static void OnResume() {
+    if (!isSuspended) {
+        return;
+    }
+    isSuspended = false;
+    pollConnectionTimer.Start();
+    matrix::SetSuspended(false);
+    leds::SetSuspended(false);
+    // Sends whatever changed while suspended
+    wakeUp.Give();
+}
+
+void PrintReport(const uint8_t* report, uint16_t size) {
     uint16_t textIndex         = 0;
     std::array<char, 100> text = {""};
 
-    for (uint16_t i = 0; i < REPORT_SIZE; ++i) {
+    for (uint16_t i = 0; i < size; ++i) {
         textIndex += snprintf(&text[textIndex],
                               sizeof(text) - textIndex,
                               "%d ",
@@ -139,14 +365,30 @@ bool SetupTask() {
     if (!task.Setup()) {
         return false;
     }
-    if (!kbReportsQueue.Setup()) {
-        return false;
-    }
     return true;
 }
 
 } // namespace usb_hid
 
+// TinyUSB device callbacks
+
+extern "C" void tud_suspend_cb(bool remote_wakeup_en) {
+    usb_hid::OnSuspend(remote_wakeup_en);
+}
+
+extern "C" void tud_resume_cb() {
+    usb_hid::OnResume();
+}
+
+// A bus reset ends a suspend without calling tud_resume_cb, and puts the
+// host back in report protocol without calling tud_hid_set_protocol_cb, so
+// the reports built for boot protocol are rebuilt too
+extern "C" void tud_mount_cb() {
+    usb_hid::isProtocolChanged = true;
+    usb_hid::OnResume();
+    usb_hid::wakeUp.Give();
+}
+
 // TinyUSB HID callbacks
 
 extern "C" const uint8_t* tud_hid_descriptor_report_cb(
@@ -154,12 +396,26 @@ extern "C" const uint8_t* tud_hid_descriptor_report_cb(
     return usb_hid::reportDescriptor;
 }
 
+extern "C" void tud_hid_report_complete_cb(
+    [[maybe_unused]] uint8_t instance,
+    [[maybe_unused]] const uint8_t* report,
+    [[maybe_unused]] uint16_t len) {
+    latency::OnReportComplete();
+    usb_hid::wakeUp.Give();
+}
+
 extern "C" uint16_t tud_hid_get_report_cb(
     [[maybe_unused]] uint8_t instance,
     [[maybe_unused]] uint8_t id,
     [[maybe_unused]] hid_report_type_t type,
     [[maybe_unused]] uint8_t* buf,
     [[maybe_unused]] uint16_t realen) {
+    if (type == HID_REPORT_TYPE_FEATURE) {
+        const uint16_t size = lamp_array::GetReport(id, buf, realen);
+        if (size) {
+            return size;
+        }
+    }
     ESP_LOGI("get report cb",
              "id: %d, type: %d, realen: %d, buf: %s",
              id,
@@ -169,12 +425,31 @@ extern "C" uint16_t tud_hid_get_report_cb(
     return 0;
 }
 
+extern "C" void tud_hid_set_protocol_cb([[maybe_unused]] uint8_t instance,
+                                        uint8_t protocol) {
+    // Reports are built for the protocol in use when they are posted, so the
+    // USB task drops the pending ones and rebuilds them
+    usb_hid::isProtocolChanged = true;
+    usb_hid::wakeUp.Give();
+    ESP_LOGI("set protocol cb",
+             "%s protocol selected",
+             protocol == HID_PROTOCOL_BOOT ? "Boot" : "Report");
+}
+
 extern "C" void tud_hid_set_report_cb([[maybe_unused]] uint8_t instance,
                                       uint8_t id,
                                       hid_report_type_t type,
                                       const uint8_t* buf,
                                       uint16_t size) {
-    if (id != 1 && type != HID_REPORT_TYPE_OUTPUT && size != 1) {
+    // Lamp updates are only staged here, the LED task shows them on its next
+    // frame
+    if (type == HID_REPORT_TYPE_FEATURE &&
+        lamp_array::SetReport(id, buf, size)) {
+        return;
+    }
+    // LED reports come without report ID in boot protocol
+    if ((id != usb_hid::KEYBOARD_REPORT_ID && id != 0) ||
+        type != HID_REPORT_TYPE_OUTPUT || size != 1) {
         // Unknown message, log and ignore it
         uint16_t index = 0;
         std::array<char, 100> text;
@@ -190,7 +465,5 @@ extern "C" void tud_hid_set_report_cb([[maybe_unused]] uint8_t instance,
                  buf);
         return;
     }
-    bool capsState = buf[0] & KEYBOARD_LED_CAPSLOCK;
-    leds::SendCommand(capsState ? leds::Commands::CapsOnUsb
-                                : leds::Commands::Usb);
+    leds::SetCapsLock(buf[0] & KEYBOARD_LED_CAPSLOCK);
 }
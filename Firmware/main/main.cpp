@@ -1,10 +1,18 @@
 #include "RtosUtils.hpp"
 
+#include "Benchmark.hpp"
+#include "DeferredLog.hpp"
 #include "Leds.hpp"
 #include "Matrix.hpp"
+#include "Power.hpp"
 #include "UsbHid.hpp"
 
 extern "C" void app_main(void) {
+    benchmark::Run();
+
+    power::Init();
+
+    deferred_log::SetupTask();
     leds::SetupTask();
     matrix::SetupTask();
     usb_hid::SetupTask();